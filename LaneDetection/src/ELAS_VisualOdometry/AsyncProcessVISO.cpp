@@ -0,0 +1,92 @@
+#include "AsyncProcessVISO.h"
+#include <algorithm>
+using namespace std;
+
+AsyncProcessVISO::AsyncProcessVISO(InterfaceProcessVISO *_proc)
+{
+	proc = _proc;
+	pending = false;
+	busy = false;
+	quit = false;
+	valid = false;
+	worker = thread(&AsyncProcessVISO::run, this);
+}
+
+AsyncProcessVISO::~AsyncProcessVISO()
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		quit = true;
+	}
+	cond.notify_all();
+	worker.join();
+}
+
+void AsyncProcessVISO::push(const Mat &left_img, const Mat &right_img)
+{
+	//gray copies of the images, the caller may reuse its buffers : processVISO uses them in place
+	Mat L, R;
+	if (left_img.channels() > 1)
+		cvtColor(left_img, L, CV_BGR2GRAY);
+	else
+		left_img.copyTo(L);
+	if (right_img.channels() > 1)
+		cvtColor(right_img, R, CV_BGR2GRAY);
+	else
+		right_img.copyTo(R);
+
+	unique_lock<mutex> lock(mtx);
+	cond.wait(lock, [this] { return !pending; });
+	left = L;
+	right = R;
+	pending = true;
+	valid = false;
+	cond.notify_all();
+}
+
+bool AsyncProcessVISO::waitMotion(Matrix44 &motion)
+{
+	unique_lock<mutex> lock(mtx);
+	cond.wait(lock, [this] { return !pending && !busy; });
+	if (valid)
+		motion = motion_last;
+	return valid;
+}
+
+void AsyncProcessVISO::run()
+{
+	while (true)
+	{
+		Mat L, R;
+		{
+			unique_lock<mutex> lock(mtx);
+			cond.wait(lock, [this] { return pending || quit; });
+			if (quit)
+				return;
+			L = left;
+			R = right;
+			left.release();
+			right.release();
+			pending = false;
+			busy = true;
+		}
+
+		bool ok = proc->processVISO(L, R);
+
+		{
+			lock_guard<mutex> lock(mtx);
+			valid = ok;
+			if (ok)
+				motion_last = Matrix44(proc->viso->getMotion());
+			busy = false;
+		}
+		cond.notify_all();
+	}
+}
+
+void AsyncProcessVISO::motionToPitchRoll(const Matrix44 &motion, double &d_pitch, double &d_roll)
+{
+	//rotation Rz * Rx * Ry of VisualOdometry::transformationVectorToMatrix : r21 = sin(rx)
+	d_pitch = asin(max(-1.0, min(1.0, motion.val[2][1])));
+	d_roll = atan2(-motion.val[0][1], motion.val[1][1]);
+}
@@ -0,0 +1,47 @@
+#ifndef ASYNCPROCESSVISO_H
+#define ASYNCPROCESSVISO_H
+
+#include "InterfaceProcessVISO.h"
+#include "matrix_fixed.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//AsyncProcessVISO runs InterfaceProcessVISO::processVISO on its own thread, so that the
+//odometry of a frame is computed while the lane detector runs LSD on the same frame.
+//push() hands over a rectified pair and returns at once, waitMotion() blocks until the
+//motion of the last pushed pair is known. Every pushed pair is processed, in order.
+//proc must not be used by the caller while an AsyncProcessVISO works on it.
+class AsyncProcessVISO {
+public:
+	AsyncProcessVISO(InterfaceProcessVISO *_proc);
+	~AsyncProcessVISO();
+
+	//the images are copied, the caller may reuse them
+	void push(const Mat &left_img, const Mat &right_img);
+
+	//motion previous -> current frame of the last pushed pair (VisualOdometry::getMotion()).
+	//false if the motion could not be estimated or nothing was pushed.
+	bool waitMotion(Matrix44 &motion);
+
+	//increments of the camera pitch (around x, positive when the camera looks down)
+	//and roll (around z), in radian, of a motion previous -> current frame
+	static void motionToPitchRoll(const Matrix44 &motion, double &d_pitch, double &d_roll);
+
+	InterfaceProcessVISO *proc;
+
+private:
+	void run();
+
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cond;
+	Mat left, right;//pair waiting for the worker
+	bool pending;
+	bool busy;
+	bool quit;
+	bool valid;//result of the last processed pair
+	Matrix44 motion_last;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "DisparityPredictor.h"
+#include <algorithm>
+using namespace std;
+
+DisparityPredictor::DisparityPredictor(double f, double cu, double cv, double base, const Param &_param)
+{
+	param = _param;
+	setCamera(f, cu, cv, base);
+	key_scale = 1;
+	key_valid = 0;
+	n_frames = 0;
+	residual = 0;
+	for (int i = 0; i < 16; i++)
+		T[i] = (i % 5 == 0) ? 1 : 0;
+}
+
+void DisparityPredictor::setCamera(double f, double cu, double cv, double base)
+{
+	_f = f, _cu = cu, _cv = cv, _base = base;
+}
+
+void DisparityPredictor::setKeyFrame(const Mat &disp, double disp_scale, const Mat &gray)
+{
+	disp.convertTo(key_disp, CV_32F, disp_scale);
+	gray.copyTo(key_gray);
+	key_scale = disp_scale > 0 ? disp_scale : 1;
+	key_valid = countNonZero(disp);
+	for (int i = 0; i < 16; i++)
+		T[i] = (i % 5 == 0) ? 1 : 0;
+	n_frames = 0;
+	residual = 0;
+}
+
+bool DisparityPredictor::needKeyFrame() const
+{
+	return key_disp.empty() || n_frames + 1 >= param.interval;
+}
+
+void DisparityPredictor::dropKeyFrame()
+{
+	key_disp.release();
+	key_gray.release();
+	key_valid = 0;
+	n_frames = 0;
+	residual = 0;
+}
+
+bool DisparityPredictor::predict(const Matrix &motion, const Mat &gray, Mat &disp)
+{
+	if (key_disp.empty() || key_valid == 0)
+		return false;
+	if (gray.size() != key_gray.size() || gray.type() != key_gray.type())
+		return false;
+
+	n_frames++;
+
+	//T = motion * T
+	double Tn[16];
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+		{
+			Tn[i * 4 + j] = 0;
+			for (int k = 0; k < 4; k++)
+				Tn[i * 4 + j] += motion.val[i][k] * T[k * 4 + j];
+		}
+	memcpy(T, Tn, sizeof(T));
+
+	int rows = key_disp.rows, cols = key_disp.cols;
+	warp_disp.create(rows, cols, CV_32FC1);
+	warp_disp.setTo(Scalar(0));
+
+	double fb = _f * _base;
+	double inv_f = 1.0 / _f;
+	double res_sum = 0;
+	int res_n = 0;
+	for (int v = 0; v < rows; v++)
+	{
+		const float* ptr_row_key = key_disp.ptr<float>(v);
+		const uchar* ptr_row_key_gray = key_gray.ptr<uchar>(v);
+		double y_n = (v - _cv) * inv_f;
+
+		for (int u = 0; u < cols; u++)
+		{
+			float d = ptr_row_key[u];
+			if (d <= 0) continue;
+
+			//back-project in key frame, transform to current frame
+			double Z = fb / d;
+			double X = (u - _cu) * inv_f * Z;
+			double Y = y_n * Z;
+			double Xc = T[0] * X + T[1] * Y + T[2] * Z + T[3];
+			double Yc = T[4] * X + T[5] * Y + T[6] * Z + T[7];
+			double Zc = T[8] * X + T[9] * Y + T[10] * Z + T[11];
+			if (Zc < 0.5) continue;
+
+			int uc = (int)(_f * Xc / Zc + _cu + 0.5);
+			int vc = (int)(_f * Yc / Zc + _cv + 0.5);
+			if (uc < 0 || uc >= cols || vc < 0 || vc >= rows) continue;
+
+			//z-buffer : the closest point (largest disparity) wins
+			float dc = (float)(fb / Zc);
+			float &w = warp_disp.ptr<float>(vc)[uc];
+			if (dc > w) w = dc;
+
+			res_sum += abs((int)ptr_row_key_gray[u] - (int)gray.ptr<uchar>(vc)[uc]);
+			res_n++;
+		}
+	}
+
+	residual = res_n > 0 ? res_sum / res_n : 1e10;
+
+	//quality gate
+	if (res_n < param.min_valid_ratio * key_valid || residual > param.max_residual)
+		return false;
+
+	fillSmallHoles(warp_disp);
+	toOutput(warp_disp, disp);
+	return true;
+}
+
+bool DisparityPredictor::predictFlatGround(double rx, double h, Mat &disp)
+{
+	if (key_disp.empty() || h <= 0)
+		return false;
+
+	n_frames++;
+	residual = 0;
+
+	//ground disparity of row v : d(v) = base / h * ((v - cv) * cos(rx) + f * sin(rx))
+	//it doesn't depend on the forward motion, so road pixels keep their disparity.
+	int rows = key_disp.rows, cols = key_disp.cols;
+	warp_disp.create(rows, cols, CV_32FC1);
+	warp_disp.setTo(Scalar(0));
+	double c = cos(rx), s = sin(rx);
+	for (int v = 0; v < rows; v++)
+	{
+		float d_ground = (float)(_base / h * ((v - _cv) * c + _f * s));
+		if (d_ground <= 0) continue;
+
+		const float* ptr_row_key = key_disp.ptr<float>(v);
+		float* ptr_row_warp = warp_disp.ptr<float>(v);
+		for (int u = 0; u < cols; u++)
+		{
+			if (ptr_row_key[u] > 0 && abs(ptr_row_key[u] - d_ground) <= param.ground_tol)
+				ptr_row_warp[u] = d_ground;
+		}
+	}
+
+	toOutput(warp_disp, disp);
+	return true;
+}
+
+//forward warping leaves holes of one or two pixels when the scene gets closer,
+//fill them with the background (smaller) disparity of the two sides.
+void DisparityPredictor::fillSmallHoles(Mat &disp_f)
+{
+	for (int v = 0; v < disp_f.rows; v++)
+	{
+		float* ptr_row = disp_f.ptr<float>(v);
+		for (int u = 1; u < disp_f.cols - 2; u++)
+		{
+			if (ptr_row[u] > 0 || ptr_row[u - 1] <= 0)
+				continue;
+
+			if (ptr_row[u + 1] > 0)
+				ptr_row[u] = min(ptr_row[u - 1], ptr_row[u + 1]);
+			else if (ptr_row[u + 2] > 0)
+			{
+				ptr_row[u] = ptr_row[u + 1] = min(ptr_row[u - 1], ptr_row[u + 2]);
+				u++;
+			}
+		}
+	}
+}
+
+void DisparityPredictor::toOutput(const Mat &disp_f, Mat &disp)
+{
+	//same 8-bit scaling as the key frame
+	disp_f.convertTo(disp, CV_8U, 1.0 / key_scale);
+}
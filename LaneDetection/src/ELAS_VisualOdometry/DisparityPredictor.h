@@ -0,0 +1,64 @@
+#ifndef DISPARITY_PREDICTOR_H
+#define DISPARITY_PREDICTOR_H
+
+#include "matrix.h"
+#include <opencv2\opencv.hpp>
+using namespace cv;
+
+//DisparityPredictor gives a cheap disparity map for the frames between two full disparity
+//computations (key frames). The last key frame disparity is warped to the current frame with
+//the ego-motion of libviso2 (or with the flat-ground model when no motion is available).
+//A full recomputation is asked when the key frame is too old or when the warp residual is high.
+class DisparityPredictor {
+public:
+	struct Param {
+		Param() : interval(5), max_residual(20), min_valid_ratio(0.5), ground_tol(2.0) {}
+
+		int interval;//compute full disparity every 'interval' frames
+		double max_residual;//mean abs gray difference between key frame and warped pixels
+		double min_valid_ratio;//warped valid pixels / key frame valid pixels
+		double ground_tol;//disparity tolerance to the flat-ground model (in pixels)
+	};
+
+	DisparityPredictor(double f = 1, double cu = 0, double cv = 0, double base = 1, const Param &_param = Param());
+
+	void setCamera(double f, double cu, double cv, double base);
+
+	//full disparity of the current frame.
+	//disp : CV_8UC1, disparity in pixels = disp * disp_scale; gray : CV_8UC1 left image.
+	void setKeyFrame(const Mat &disp, double disp_scale, const Mat &gray);
+
+	//true when a full disparity map should be computed for this frame
+	bool needKeyFrame() const;
+	//forget the key frame, e.g. a frame went by without its motion : the next frame is a key frame
+	void dropKeyFrame();
+
+	//warp the key frame with the motion previous -> current (VisualOdometry::getMotion()).
+	//returns false when the quality gate fails, disp is then not usable.
+	bool predict(const Matrix &motion, const Mat &gray, Mat &disp);
+
+	//no motion available : keep key frame pixels lying on the road (flat ground, pitch rx,
+	//camera height h) with the disparity of the model. Obstacles are dropped.
+	bool predictFlatGround(double rx, double h, Mat &disp);
+
+	int framesSinceKeyFrame() const { return n_frames; }
+	double lastResidual() const { return residual; }
+
+	Param param;
+
+private:
+	double _f, _cu, _cv, _base;
+	Mat key_disp;//CV_32FC1, disparity in pixels
+	Mat key_gray;
+	double key_scale;
+	int key_valid;
+	double T[16];//accumulated motion key frame -> current, row major
+	int n_frames;
+	double residual;
+
+	Mat warp_disp;//CV_32FC1 z-buffer of the warp
+	void fillSmallHoles(Mat &disp_f);
+	void toOutput(const Mat &disp_f, Mat &disp);
+};
+
+#endif
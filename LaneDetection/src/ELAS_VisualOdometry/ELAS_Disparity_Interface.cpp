@@ -1,4 +1,6 @@
 #include "ELAS_Disparity_Interface.h"
+#include <iostream>
+using namespace std;
 
 InterfaceProcessELAS::InterfaceProcessELAS()
 {
@@ -7,6 +9,7 @@ InterfaceProcessELAS::InterfaceProcessELAS()
 		param.postprocess_only_left = true;
 	}
 	elas = new Elas(param);
+	dispScale = 1;
 }
 
 InterfaceProcessELAS::InterfaceProcessELAS(Elas::parameters _param)
@@ -17,19 +20,21 @@ InterfaceProcessELAS::InterfaceProcessELAS(Elas::parameters _param)
 		param.postprocess_only_left = true;
 	}
 	elas = new Elas(param);
+	dispScale = 1;
 }
 void InterfaceProcessELAS::computeDisparity(const Mat &left_img,
 	const Mat &right_img, Mat &disp)
 {
+	//loadFromCVMatGray copies the gray images, they only have to be continuous
 	Mat L, R;
 	if (left_img.channels() > 1)
 		cvtColor(left_img, L, CV_BGR2GRAY);
 	else
-		left_img.copyTo(L);
+		L = left_img.isContinuous() ? left_img : left_img.clone();
 	if (right_img.channels() > 1)
 		cvtColor(right_img, R, CV_BGR2GRAY);
 	else
-		right_img.copyTo(R);
+		R = right_img.isContinuous() ? right_img : right_img.clone();
 
 	
 	image<uchar> *I1, *I2;
@@ -40,8 +45,16 @@ void InterfaceProcessELAS::computeDisparity(const Mat &left_img,
 	int32_t height = I1->height();
 
 	const int32_t dims[3] = { width, height, width }; // bytes per line = width
-	float* D1_data = (float*)malloc(width*height*sizeof(float));
-	float* D2_data = (float*)malloc(width*height*sizeof(float));
+
+	// with subsampling elas only computes every 2nd pixel : D1, D2 are width/2 x height/2
+	int32_t D_width = width, D_height = height;
+	if (param.subsampling)
+	{
+		D_width = width / 2;
+		D_height = height / 2;
+	}
+	float* D1_data = (float*)malloc(D_width*D_height*sizeof(float));
+	float* D2_data = (float*)malloc(D_width*D_height*sizeof(float));
 
 	elas->process(I1->data, I2->data, D1_data, D2_data, dims);
 
@@ -50,14 +63,20 @@ void InterfaceProcessELAS::computeDisparity(const Mat &left_img,
 
 	// find maximum disparity for scaling output disparity images to [0..255]
 	float disp_max = 0;
-	for (int32_t i = 0; i<width*height; i++) {
+	for (int32_t i = 0; i<D_width*D_height; i++) {
 		if (D1_data[i]>disp_max) disp_max = D1_data[i];
 		if (D2_data[i]>disp_max) disp_max = D2_data[i];
 	}
 
+	// elas gives disparities in pixels of the full resolution image,
+	// dispScale is in pixels of the output map
+	dispScale = disp_max > 0 ? disp_max / 255.0 : 1;
+	if (param.subsampling)
+		dispScale *= 0.5;
+
 	// copy float to uchar
-	image<uchar> *D1 = new image<uchar>(width, height);
-	for (int32_t i = 0; i<width*height; i++) {
+	image<uchar> *D1 = new image<uchar>(D_width, D_height);
+	for (int32_t i = 0; i<D_width*D_height; i++) {
 		D1->data[i] = (uint8_t)max(255.0*D1_data[i] / disp_max, 0.0);
 	}
 
@@ -72,4 +91,69 @@ void InterfaceProcessELAS::computeDisparity(const Mat &left_img,
 	delete D2_data;
 	delete I1;
 	delete I2;
-}
\ No newline at end of file
+}
+
+void InterfaceProcessELAS::benchmarkTriangulation(const Mat &left_img,
+	const Mat &right_img, int n_runs)
+{
+	Mat L, R;
+	if (left_img.channels() > 1)
+		cvtColor(left_img, L, CV_BGR2GRAY);
+	else
+		left_img.copyTo(L);
+	if (right_img.channels() > 1)
+		cvtColor(right_img, R, CV_BGR2GRAY);
+	else
+		right_img.copyTo(R);
+
+	image<uchar> *I1, *I2;
+	I1 = loadFromCVMatGray(L);
+	I2 = loadFromCVMatGray(R);
+
+	int32_t width = I1->width();
+	int32_t height = I1->height();
+	const int32_t dims[3] = { width, height, width };
+	int32_t D_size = param.subsampling ? (width / 2) * (height / 2) : width * height;
+
+	// [0] : delaunay, [1] : grid
+	float* D1_data[2];
+	float* D2_data = (float*)malloc(D_size*sizeof(float));
+	double time_ms[2];
+	for (int k = 0; k < 2; k++)
+	{
+		Elas::parameters _param = param;
+		_param.grid_triangulation = (k == 1);
+		Elas elas_k(_param);
+		D1_data[k] = (float*)malloc(D_size*sizeof(float));
+
+		int64 t0 = getTickCount();
+		for (int i = 0; i < n_runs; i++)
+			elas_k.process(I1->data, I2->data, D1_data[k], D2_data, dims);
+		time_ms[k] = (getTickCount() - t0) / getTickFrequency() * 1000 / max(n_runs, 1);
+	}
+
+	// difference on the pixels valid in both maps
+	double sum_diff = 0;
+	int n_both = 0, n_valid[2] = { 0, 0 };
+	for (int32_t i = 0; i < D_size; i++)
+	{
+		bool valid_0 = D1_data[0][i] >= 0, valid_1 = D1_data[1][i] >= 0;
+		n_valid[0] += valid_0;
+		n_valid[1] += valid_1;
+		if (valid_0 && valid_1)
+		{
+			sum_diff += fabs(D1_data[0][i] - D1_data[1][i]);
+			n_both++;
+		}
+	}
+
+	cout << "elas delaunay : " << time_ms[0] << " ms, valid " << 100.0 * n_valid[0] / D_size << " %" << endl;
+	cout << "elas grid     : " << time_ms[1] << " ms, valid " << 100.0 * n_valid[1] / D_size << " %" << endl;
+	cout << "mean abs disparity difference : " << (n_both > 0 ? sum_diff / n_both : 0) << " px" << endl;
+
+	free(D1_data[0]);
+	free(D1_data[1]);
+	free(D2_data);
+	delete I1;
+	delete I2;
+}
@@ -15,9 +15,16 @@ public:
 
 	Elas::parameters param;
 	Elas *elas;
+	double dispScale;//disparity in pixels of disp = disp * dispScale (disp is scaled to [0..255])
 
+	//disp : CV_8UC1, half the size of left_img if param.subsampling is set
 	void computeDisparity(const Mat &left_img,
 		const Mat &right_img, Mat &disp);
+
+	//runs elas with delaunay and with grid triangulation (param.grid_triangulation) on the same pair,
+	//prints the mean time of each and the mean absolute difference of the left disparity maps.
+	void benchmarkTriangulation(const Mat &left_img,
+		const Mat &right_img, int n_runs = 5);
 	
 };
 
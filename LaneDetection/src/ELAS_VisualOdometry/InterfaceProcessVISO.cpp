@@ -8,7 +8,7 @@ InterfaceProcessVISO::InterfaceProcessVISO(VisualOdometryStereo::parameters _par
 	param = _param;
 	width = _width;
 	height = _height;
-	pose = Matrix::eye(4);
+	pose = Matrix44::eye();
 	viso = new VisualOdometryStereo(param);
 }
 
@@ -22,7 +22,7 @@ InterfaceProcessVISO::InterfaceProcessVISO(Calib_Data_Type calibData)
 
 	width = calibData.S_rect_00[0];
 	height = calibData.S_rect_00[1];
-	pose = Matrix::eye(4);
+	pose = Matrix44::eye();
 	viso = new VisualOdometryStereo(param);
 }
 
@@ -33,21 +33,22 @@ void InterfaceProcessVISO::init(VisualOdometryStereo::parameters _param,
 	viso = new VisualOdometryStereo(param);
 	width = _width;
 	height = _height;
-	pose = Matrix::eye(4);
+	pose = Matrix44::eye();
 }
 
-void InterfaceProcessVISO::processVISO(const Mat &left_img,
+bool InterfaceProcessVISO::processVISO(const Mat &left_img,
 	const Mat &right_img)
 {
-	Mat L, R;
+	//libviso2 reads the images during process() only : gray continuous images are used in place
+	Mat L = left_img, R = right_img;
 	if (left_img.channels() > 1)
 		cvtColor(left_img, L, CV_BGR2GRAY);
-	else
-		left_img.copyTo(L);
+	else if (!left_img.isContinuous())
+		L = left_img.clone();
 	if (right_img.channels() > 1)
 		cvtColor(right_img, R, CV_BGR2GRAY);
-	else
-		right_img.copyTo(R);
+	else if (!right_img.isContinuous())
+		R = right_img.clone();
 
 
 	left_img_data = (uint8_t*)L.data;
@@ -56,7 +57,9 @@ void InterfaceProcessVISO::processVISO(const Mat &left_img,
 	int32_t dims[] = { width, height, width };
 	if (viso->process(left_img_data, right_img_data, dims)) {
 		// on success, update current pose
-		pose = pose * Matrix::inv(viso->getMotion());
+		pose = pose * invRigid(Matrix44(viso->getMotion()));
+		return true;
 	}
+	return false;
 
 }
@@ -4,6 +4,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "png++/png.hpp"
 #include "viso_stereo.h"
+#include "matrix_fixed.h"
 #include "../KITTI_Data_Reader/KITTI_Data_Reader.h"
 #include <opencv2\opencv.hpp>
 using namespace cv;
@@ -23,12 +24,12 @@ public:
 	VisualOdometryStereo::parameters param;
 	VisualOdometryStereo *viso;
 	int width, height;
-	Matrix pose;
+	Matrix44 pose;//camera pose, updated in place (no heap allocation per frame)
 
 	void processVISO(png::image< png::gray_pixel > left_img,
 		png::image< png::gray_pixel > right_img);
-	void processVISO(const Mat &left_img,
-		const Mat &right_img);
+	bool processVISO(const Mat &left_img,
+		const Mat &right_img);//false if the motion could not be estimated
 
 private :
 	void init(VisualOdometryStereo::parameters _param,
@@ -70,17 +70,35 @@ void Elas::process (uint8_t* I1_,uint8_t* I2_,float* D1,float* D2,const int32_t*
     return;
   }
 
+  // lattice triangulation: one mesh (with its planes) for both images, its vertices are p_node
+  vector<support_pt> p_node;
+  vector<triangle> tri_1,tri_2;
+  if (param.grid_triangulation) {
 #ifdef PROFILE
-  timer.start("Delaunay Triangulation");
+    timer.start("Grid Triangulation");
 #endif
-  vector<triangle> tri_1 = computeDelaunayTriangulation(p_support,0);
-  vector<triangle> tri_2 = computeDelaunayTriangulation(p_support,1);
+    tri_1 = computeGridTriangulation(p_support,p_node);
+  }
+  bool grid_mesh = !tri_1.empty();
+
+  if (!grid_mesh) {
+#ifdef PROFILE
+    timer.start("Delaunay Triangulation");
+#endif
+    tri_1 = computeDelaunayTriangulation(p_support,0);
+    tri_2 = computeDelaunayTriangulation(p_support,1);
+  }
 
 #ifdef PROFILE
   timer.start("Disparity Planes");
 #endif
-  computeDisparityPlanes(p_support,tri_1,0);
-  computeDisparityPlanes(p_support,tri_2,1);
+  // planes of the lattice triangles are computed with the triangulation
+  if (!grid_mesh) {
+    computeDisparityPlanes(p_support,tri_1,0);
+    computeDisparityPlanes(p_support,tri_2,1);
+  }
+  const vector<support_pt> &p_tri = grid_mesh ? p_node : p_support;
+  const vector<triangle> &tri_right = grid_mesh ? tri_1 : tri_2;
 
 #ifdef PROFILE
   timer.start("Grid");
@@ -99,8 +117,8 @@ void Elas::process (uint8_t* I1_,uint8_t* I2_,float* D1,float* D2,const int32_t*
 #ifdef PROFILE
   timer.start("Matching");
 #endif
-  computeDisparity(p_support,tri_1,disparity_grid_1,grid_dims,desc1.I_desc,desc2.I_desc,0,D1);
-  computeDisparity(p_support,tri_2,disparity_grid_2,grid_dims,desc1.I_desc,desc2.I_desc,1,D2);
+  computeDisparity(p_tri,tri_1,disparity_grid_1,grid_dims,desc1.I_desc,desc2.I_desc,0,D1);
+  computeDisparity(p_tri,tri_right,disparity_grid_2,grid_dims,desc1.I_desc,desc2.I_desc,1,D2);
 
 #ifdef PROFILE
   timer.start("L/R Consistency Check");
@@ -442,7 +460,7 @@ vector<Elas::support_pt> Elas::computeSupportMatches (uint8_t* I1_desc,uint8_t*
   return p_support; 
 }
 
-vector<Elas::triangle> Elas::computeDelaunayTriangulation (vector<support_pt> p_support,int32_t right_image) {
+vector<Elas::triangle> Elas::computeDelaunayTriangulation (const vector<support_pt> &p_support,int32_t right_image) {
 
   // input/output structure for triangulation
   struct triangulateio in, out;
@@ -504,7 +522,153 @@ vector<Elas::triangle> Elas::computeDelaunayTriangulation (vector<support_pt> p_
   return tri;
 }
 
-void Elas::computeDisparityPlanes (vector<support_pt> p_support,vector<triangle> &tri,int32_t right_image) {
+vector<Elas::triangle> Elas::computeGridTriangulation (const vector<support_pt> &p_support,vector<support_pt> &p_node) {
+
+  // same lattice as computeSupportMatches(), candidates are matched from the second row/column on
+  int32_t D_candidate_stepsize = param.candidate_stepsize;
+  if (param.subsampling)
+    D_candidate_stepsize += D_candidate_stepsize%2;
+
+  // lattice coordinates, image borders are added when corner support points are requested
+  vector<int32_t> lat_u,lat_v;
+  if (param.add_corners) { lat_u.push_back(0); lat_v.push_back(0); }
+  for (int32_t u=D_candidate_stepsize; u<width;  u+=D_candidate_stepsize) lat_u.push_back(u);
+  for (int32_t v=D_candidate_stepsize; v<height; v+=D_candidate_stepsize) lat_v.push_back(v);
+  if (param.add_corners && lat_u.back()<width-1)  lat_u.push_back(width-1);
+  if (param.add_corners && lat_v.back()<height-1) lat_v.push_back(height-1);
+
+  vector<triangle> tri;
+  int32_t n_u = lat_u.size();
+  int32_t n_v = lat_v.size();
+  if (n_u<2 || n_v<2)
+    return tri;
+
+  // put support points on their node (-1 = missing), off-lattice points are skipped
+  int32_t offset = param.add_corners ? 0 : -1;
+  int32_t* node_d = (int32_t*)malloc(n_u*n_v*sizeof(int32_t));
+  for (int32_t i=0; i<n_u*n_v; i++)
+    node_d[i] = -1;
+  int32_t num_valid = 0;
+  for (uint32_t i=0; i<p_support.size(); i++) {
+    int32_t i_u = p_support[i].u/D_candidate_stepsize+offset;
+    int32_t i_v = p_support[i].v/D_candidate_stepsize+offset;
+    if (i_u<0 || i_u>=n_u || lat_u[i_u]!=p_support[i].u) {
+      if (lat_u[n_u-1]!=p_support[i].u) continue;
+      i_u = n_u-1;
+    }
+    if (i_v<0 || i_v>=n_v || lat_v[i_v]!=p_support[i].v) {
+      if (lat_v[n_v-1]!=p_support[i].v) continue;
+      i_v = n_v-1;
+    }
+    node_d[getAddressOffsetImage(i_u,i_v,n_u)] = p_support[i].d;
+    num_valid++;
+  }
+
+  if (num_valid==0) {
+    free(node_d);
+    return tri;
+  }
+
+  // missing nodes: gaps inside rows first, then columns, then what remains in rows.
+  // as with delaunay, nodes outside of the support points are only filled if corners are requested
+  bool extrapolate = param.add_corners;
+  for (int32_t i_v=0; i_v<n_v; i_v++)
+    fillGridGaps(node_d+i_v*n_u,n_u,1,false);
+  for (int32_t i_u=0; i_u<n_u; i_u++)
+    fillGridGaps(node_d+i_u,n_v,n_u,extrapolate);
+  for (int32_t i_v=0; i_v<n_v; i_v++)
+    fillGridGaps(node_d+i_v*n_u,n_u,1,extrapolate);
+
+  p_node.clear();
+  p_node.reserve(n_u*n_v);
+  for (int32_t i_v=0; i_v<n_v; i_v++)
+    for (int32_t i_u=0; i_u<n_u; i_u++)
+      p_node.push_back(support_pt(lat_u[i_u],lat_v[i_v],node_d[getAddressOffsetImage(i_u,i_v,n_u)]));
+
+  // two triangles per cell, split along the diagonal with the smaller disparity change.
+  // cells with a missing node are left out
+  tri.reserve(2*(n_u-1)*(n_v-1));
+  for (int32_t i_v=0; i_v<n_v-1; i_v++) {
+    for (int32_t i_u=0; i_u<n_u-1; i_u++) {
+      int32_t tl = getAddressOffsetImage(i_u,i_v,n_u);
+      int32_t tr = tl+1;
+      int32_t bl = tl+n_u;
+      int32_t br = bl+1;
+      if (node_d[tl]<0 || node_d[tr]<0 || node_d[bl]<0 || node_d[br]<0)
+        continue;
+      if (abs(node_d[tl]-node_d[br])<=abs(node_d[tr]-node_d[bl])) {
+        tri.push_back(triangle(tl,tr,br));
+        tri.push_back(triangle(tl,br,bl));
+      } else {
+        tri.push_back(triangle(tl,tr,bl));
+        tri.push_back(triangle(tr,br,bl));
+      }
+    }
+  }
+
+  // disparity planes in closed form (lattice triangles are never degenerated in the left image)
+  for (uint32_t i=0; i<tri.size(); i++) {
+    const support_pt &p1 = p_node[tri[i].c1];
+    const support_pt &p2 = p_node[tri[i].c2];
+    const support_pt &p3 = p_node[tri[i].c3];
+    if (!solvePlane(p1.u,p1.v,p1.d,p2.u,p2.v,p2.d,p3.u,p3.v,p3.d,tri[i].t1a,tri[i].t1b,tri[i].t1c))
+      tri[i].t1a = tri[i].t1b = tri[i].t1c = 0;
+    if (!solvePlane(p1.u-p1.d,p1.v,p1.d,p2.u-p2.d,p2.v,p2.d,p3.u-p3.d,p3.v,p3.d,tri[i].t2a,tri[i].t2b,tri[i].t2c))
+      tri[i].t2a = tri[i].t2b = tri[i].t2c = 0;
+  }
+
+  free(node_d);
+  return tri;
+}
+
+bool Elas::solvePlane (double u1,double v1,double d1,double u2,double v2,double d2,
+                       double u3,double v3,double d3,float &a,float &b,float &c) {
+
+  // cramer's rule for a*u+b*v+c = d through the 3 points
+  double det = u1*(v2-v3)-v1*(u2-u3)+(u2*v3-u3*v2);
+  if (fabs(det)<1e-6)
+    return false;
+  a = (float)((d1*(v2-v3)-v1*(d2-d3)+(d2*v3-d3*v2))/det);
+  b = (float)((u1*(d2-d3)-d1*(u2-u3)+(u2*d3-u3*d2))/det);
+  c = (float)((u1*(v2*d3-v3*d2)-v1*(u2*d3-u3*d2)+d1*(u2*v3-u3*v2))/det);
+  return true;
+}
+
+void Elas::fillGridGaps (int32_t* node_d,int32_t n,int32_t stride,bool extrapolate) {
+
+  // walk along the line, fill between consecutive valid nodes
+  int32_t i_prev = -1;
+  for (int32_t i=0; i<n; i++) {
+    if (node_d[i*stride]<0)
+      continue;
+
+    if (i_prev<0) {
+      // extrapolate towards the border
+      if (extrapolate)
+        for (int32_t j=0; j<i; j++)
+          node_d[j*stride] = node_d[i*stride];
+    } else if (i-i_prev>1) {
+      // smooth surface: linear interpolation, disparity jump: take the background (as gapInterpolation)
+      int32_t d1 = node_d[i_prev*stride];
+      int32_t d2 = node_d[i*stride];
+      bool smooth = abs(d1-d2)<=param.incon_threshold*(i-i_prev);
+      for (int32_t j=i_prev+1; j<i; j++) {
+        if (smooth)
+          node_d[j*stride] = d1+(d2-d1)*(j-i_prev)/(i-i_prev);
+        else
+          node_d[j*stride] = min(d1,d2);
+      }
+    }
+    i_prev = i;
+  }
+
+  // extrapolate towards the other border
+  if (extrapolate && i_prev>=0)
+    for (int32_t j=i_prev+1; j<n; j++)
+      node_d[j*stride] = node_d[i_prev*stride];
+}
+
+void Elas::computeDisparityPlanes (const vector<support_pt> &p_support,vector<triangle> &tri,int32_t right_image) {
 
   // init matrices
   Matrix A(3,3);
@@ -576,7 +740,7 @@ void Elas::computeDisparityPlanes (vector<support_pt> p_support,vector<triangle>
   }  
 }
 
-void Elas::createGrid(vector<support_pt> p_support,int32_t* disparity_grid,int32_t* grid_dims,bool right_image) {
+void Elas::createGrid(const vector<support_pt> &p_support,int32_t* disparity_grid,int32_t* grid_dims,bool right_image) {
   
   // get grid dimensions
   int32_t grid_width  = grid_dims[1];
@@ -780,7 +944,7 @@ inline void Elas::findMatch(int32_t &u,int32_t &v,float &plane_a,float &plane_b,
 }
 
 // TODO: %2 => more elegantly
-void Elas::computeDisparity(vector<support_pt> p_support,vector<triangle> tri,int32_t* disparity_grid,int32_t *grid_dims,
+void Elas::computeDisparity(const vector<support_pt> &p_support,const vector<triangle> &tri,int32_t* disparity_grid,int32_t *grid_dims,
                             uint8_t* I1_desc,uint8_t* I2_desc,bool right_image,float* D) {
 
   // number of disparities
@@ -83,6 +83,9 @@ public:
     bool    subsampling;            // saves time by only computing disparities for each 2nd pixel
                                     // note: for this option D1 and D2 must be passed with size
                                     //       width/2 x height/2 (rounded towards zero)
+    bool    grid_triangulation;     // triangulate the support points on their candidate_stepsize lattice
+                                    // (two triangles per cell, missing nodes interpolated) instead of
+                                    // two delaunay triangulations; faster, approximates occlusion borders
     
     // constructor
     parameters (setting s=ROBOTICS) {
@@ -114,6 +117,7 @@ public:
         filter_adaptive_mean  = 1;
         postprocess_only_left = 1;
         subsampling           = 0;
+        grid_triangulation    = 0;
         
       // default settings for middlebury benchmark
       // (interpolate all missing disparities)
@@ -141,6 +145,7 @@ public:
         filter_adaptive_mean  = 0;
         postprocess_only_left = 0;
         subsampling           = 0;
+        grid_triangulation    = 0;
       }
     }
   };
@@ -195,9 +200,13 @@ private:
   std::vector<support_pt> computeSupportMatches (uint8_t* I1_desc,uint8_t* I2_desc);
 
   // triangulation & grid
-  std::vector<triangle> computeDelaunayTriangulation (std::vector<support_pt> p_support,int32_t right_image);
-  void computeDisparityPlanes (std::vector<support_pt> p_support,std::vector<triangle> &tri,int32_t right_image);
-  void createGrid (std::vector<support_pt> p_support,int32_t* disparity_grid,int32_t* grid_dims,bool right_image);
+  std::vector<triangle> computeDelaunayTriangulation (const std::vector<support_pt> &p_support,int32_t right_image);
+  std::vector<triangle> computeGridTriangulation (const std::vector<support_pt> &p_support,std::vector<support_pt> &p_node);
+  void fillGridGaps (int32_t* node_d,int32_t n,int32_t stride,bool extrapolate);
+  bool solvePlane (double u1,double v1,double d1,double u2,double v2,double d2,
+                   double u3,double v3,double d3,float &a,float &b,float &c);
+  void computeDisparityPlanes (const std::vector<support_pt> &p_support,std::vector<triangle> &tri,int32_t right_image);
+  void createGrid (const std::vector<support_pt> &p_support,int32_t* disparity_grid,int32_t* grid_dims,bool right_image);
 
   // matching
   inline void updatePosteriorMinimum (__m128i* I2_block_addr,const int32_t &d,const int32_t &w,
@@ -207,7 +216,7 @@ private:
   inline void findMatch (int32_t &u,int32_t &v,float &plane_a,float &plane_b,float &plane_c,
                          int32_t* disparity_grid,int32_t *grid_dims,uint8_t* I1_desc,uint8_t* I2_desc,
                          int32_t *P,int32_t &plane_radius,bool &valid,bool &right_image,float* D);
-  void computeDisparity (std::vector<support_pt> p_support,std::vector<triangle> tri,int32_t* disparity_grid,int32_t* grid_dims,
+  void computeDisparity (const std::vector<support_pt> &p_support,const std::vector<triangle> &tri,int32_t* disparity_grid,int32_t* grid_dims,
                          uint8_t* I1_desc,uint8_t* I2_desc,bool right_image,float* D);
 
   // L/R consistency check
@@ -23,8 +23,26 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #include "triangle.h"
 #include "filter.h"
 
+#include <thread>
+
 using namespace std;
 
+// calls body(i_start,i_end) for num_threads contiguous chunks of [0,n), the first chunk
+// in the calling thread
+template<class Body>
+static void parallelRange (int32_t n,int32_t num_threads,Body body) {
+  if (num_threads<=1 || n<=1) {
+    body(0,n);
+    return;
+  }
+  vector<thread> workers;
+  for (int32_t t=1; t<num_threads; t++)
+    workers.push_back(thread(body,(int32_t)((int64_t)n*t/num_threads),(int32_t)((int64_t)n*(t+1)/num_threads)));
+  body(0,(int32_t)(n/num_threads));
+  for (int32_t t=0; t<(int32_t)workers.size(); t++)
+    workers[t].join();
+}
+
 //////////////////////
 // PUBLIC FUNCTIONS //
 //////////////////////
@@ -174,10 +192,18 @@ void Matcher::pushBack (uint8_t *I1,uint8_t* I2,int32_t* dims,const bool replace
     }
   }
 
-  // compute new features for current frame
-  computeFeatures(I1c,dims_c,m1c1,n1c1,m1c2,n1c2,I1c_du,I1c_dv,I1c_du_full,I1c_dv_full);
-  if (I2!=0)
-    computeFeatures(I2c,dims_c,m2c1,n2c1,m2c2,n2c2,I2c_du,I2c_dv,I2c_du_full,I2c_dv_full);
+  // compute new features for current frame, the right image in a second thread
+  if (I2!=0 && getNumThreads(2)>1) {
+    thread right_features([&]() {
+      computeFeatures(I2c,dims_c,m2c1,n2c1,m2c2,n2c2,I2c_du,I2c_dv,I2c_du_full,I2c_dv_full);
+    });
+    computeFeatures(I1c,dims_c,m1c1,n1c1,m1c2,n1c2,I1c_du,I1c_dv,I1c_du_full,I1c_dv_full);
+    right_features.join();
+  } else {
+    computeFeatures(I1c,dims_c,m1c1,n1c1,m1c2,n1c2,I1c_du,I1c_dv,I1c_du_full,I1c_dv_full);
+    if (I2!=0)
+      computeFeatures(I2c,dims_c,m2c1,n2c1,m2c2,n2c2,I2c_du,I2c_dv,I2c_du_full,I2c_dv_full);
+  }
 }
 
 void Matcher::matchFeatures(int32_t method, Matrix *Tr_delta) {
@@ -867,6 +893,13 @@ void Matcher::computePriorStatistics (vector<Matcher::p_match> &p_matched,int32_
   delete []delta_accu;
 }
 
+int32_t Matcher::getNumThreads (int32_t n) {
+  int32_t num_threads = param.num_threads;
+  if (num_threads<=0)
+    num_threads = (int32_t)thread::hardware_concurrency();
+  return max(1,min(num_threads,n));
+}
+
 void Matcher::createIndexVector (int32_t* m,int32_t n,vector<int32_t> *k,const int32_t &u_bin_num,const int32_t &v_bin_num) {
 
   // descriptor step size
@@ -983,8 +1016,12 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
   
   // loop variables
   int32_t* M = (int32_t*)calloc(dims_c[0]*dims_c[1],sizeof(int32_t));
-  int32_t i1p,i2p,i1c,i2c,i1c2,i1p2;
-  int32_t u1p,v1p,u2p,v2p,u1c,v1c,u2c,v2c;
+  int32_t i1p,i1c;
+  int32_t u1c,v1c;
+
+  // per point results of the parallel loops
+  vector<char> found;
+  vector<Matcher::p_match> candidate;
   
   double t00,t01,t02,t03,t10,t11,t12,t13,t20,t21,t22,t23;
   if (Tr_delta) {
@@ -1010,35 +1047,47 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
     createIndexVector(m1p,n1p,k1p,u_bin_num,v_bin_num);
     createIndexVector(m1c,n1c,k1c,u_bin_num,v_bin_num);
     
-    // for all points do
-    for (i1c=0; i1c<n1c; i1c++) {
-
-      // coordinates in previous left image
-      u1c = *(m1c+step_size*i1c+0);
-      v1c = *(m1c+step_size*i1c+1);
-
-      // compute row and column of statistics bin to which this observation belongs
-      int32_t u_bin = min((int32_t)floor((float)u1c/(float)param.match_binsize),u_bin_num-1);
-      int32_t v_bin = min((int32_t)floor((float)v1c/(float)param.match_binsize),v_bin_num-1);
-      int32_t stat_bin = v_bin*u_bin_num+u_bin;
-
-      // match forward/backward
-      findMatch(m1c,i1c,m1p,step_size,k1p,u_bin_num,v_bin_num,stat_bin,i1p, 0,true,use_prior);
-      findMatch(m1p,i1p,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c2,1,true,use_prior);
-
-      // circle closure success?
-      if (i1c2==i1c) {
-
-        // extract coordinates
-        u1p = *(m1p+step_size*i1p+0);
-        v1p = *(m1p+step_size*i1p+1);
-
-        // add match if this pixel isn't matched yet
-        if (*(M+getAddressOffsetImage(u1c,v1c,dims_c[0]))==0) {
-          p_matched.push_back(Matcher::p_match(u1p,v1p,i1p,-1,-1,-1,u1c,v1c,i1c,-1,-1,-1));
-          *(M+getAddressOffsetImage(u1c,v1c,dims_c[0])) = 1;
+    // for all points do (in parallel, the index vectors are only read)
+    found.assign(n1c,0);
+    candidate.resize(n1c);
+    parallelRange(n1c,getNumThreads(n1c/256+1),[&](int32_t i_start,int32_t i_end) {
+      for (int32_t i1c=i_start; i1c<i_end; i1c++) {
+        int32_t i1p,i1c2;
+
+        // coordinates in previous left image
+        int32_t u1c = *(m1c+step_size*i1c+0);
+        int32_t v1c = *(m1c+step_size*i1c+1);
+
+        // compute row and column of statistics bin to which this observation belongs
+        int32_t u_bin = min((int32_t)floor((float)u1c/(float)param.match_binsize),u_bin_num-1);
+        int32_t v_bin = min((int32_t)floor((float)v1c/(float)param.match_binsize),v_bin_num-1);
+        int32_t stat_bin = v_bin*u_bin_num+u_bin;
+
+        // match forward/backward
+        findMatch(m1c,i1c,m1p,step_size,k1p,u_bin_num,v_bin_num,stat_bin,i1p, 0,true,use_prior);
+        findMatch(m1p,i1p,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c2,1,true,use_prior);
+
+        // circle closure success?
+        if (i1c2==i1c) {
+
+          // extract coordinates
+          int32_t u1p = *(m1p+step_size*i1p+0);
+          int32_t v1p = *(m1p+step_size*i1p+1);
+          candidate[i1c] = Matcher::p_match(u1p,v1p,i1p,-1,-1,-1,u1c,v1c,i1c,-1,-1,-1);
+          found[i1c] = 1;
         }
       }
+    });
+
+    // add match if this pixel isn't matched yet (in order, as the sequential loop)
+    for (i1c=0; i1c<n1c; i1c++) {
+      if (!found[i1c]) continue;
+      u1c = (int32_t)candidate[i1c].u1c;
+      v1c = (int32_t)candidate[i1c].v1c;
+      if (*(M+getAddressOffsetImage(u1c,v1c,dims_c[0]))==0) {
+        p_matched.push_back(candidate[i1c]);
+        *(M+getAddressOffsetImage(u1c,v1c,dims_c[0])) = 1;
+      }
     }
     
   /////////////////////////////////////////////////////
@@ -1049,39 +1098,51 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
     createIndexVector(m1c,n1c,k1c,u_bin_num,v_bin_num);
     createIndexVector(m2c,n2c,k2c,u_bin_num,v_bin_num);
     
-    // for all points do
-    for (i1c=0; i1c<n1c; i1c++) {
-
-      // coordinates in previous left image
-      u1c = *(m1c+step_size*i1c+0);
-      v1c = *(m1c+step_size*i1c+1);
-
-      // compute row and column of statistics bin to which this observation belongs
-      int32_t u_bin = min((int32_t)floor((float)u1c/(float)param.match_binsize),u_bin_num-1);
-      int32_t v_bin = min((int32_t)floor((float)v1c/(float)param.match_binsize),v_bin_num-1);
-      int32_t stat_bin = v_bin*u_bin_num+u_bin;
-
-      // match left/right
-      findMatch(m1c,i1c,m2c,step_size,k2c,u_bin_num,v_bin_num,stat_bin,i2c, 0,false,use_prior);
-      findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c2,1,false,use_prior);
-
-      // circle closure success?
-      if (i1c2==i1c) {
-
-        // extract coordinates
-        u2c = *(m2c+step_size*i2c+0);
-        v2c = *(m2c+step_size*i2c+1);
-
-        // if disparity is positive
-        if (u1c>=u2c) {
-
-          // add match if this pixel isn't matched yet
-          if (*(M+getAddressOffsetImage(u1c,v1c,dims_c[0]))==0) {
-            p_matched.push_back(Matcher::p_match(-1,-1,-1,-1,-1,-1,u1c,v1c,i1c,u2c,v2c,i2c));
-            *(M+getAddressOffsetImage(u1c,v1c,dims_c[0])) = 1;
+    // for all points do (in parallel, the index vectors are only read)
+    found.assign(n1c,0);
+    candidate.resize(n1c);
+    parallelRange(n1c,getNumThreads(n1c/256+1),[&](int32_t i_start,int32_t i_end) {
+      for (int32_t i1c=i_start; i1c<i_end; i1c++) {
+        int32_t i2c,i1c2;
+
+        // coordinates in previous left image
+        int32_t u1c = *(m1c+step_size*i1c+0);
+        int32_t v1c = *(m1c+step_size*i1c+1);
+
+        // compute row and column of statistics bin to which this observation belongs
+        int32_t u_bin = min((int32_t)floor((float)u1c/(float)param.match_binsize),u_bin_num-1);
+        int32_t v_bin = min((int32_t)floor((float)v1c/(float)param.match_binsize),v_bin_num-1);
+        int32_t stat_bin = v_bin*u_bin_num+u_bin;
+
+        // match left/right
+        findMatch(m1c,i1c,m2c,step_size,k2c,u_bin_num,v_bin_num,stat_bin,i2c, 0,false,use_prior);
+        findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c2,1,false,use_prior);
+
+        // circle closure success?
+        if (i1c2==i1c) {
+
+          // extract coordinates
+          int32_t u2c = *(m2c+step_size*i2c+0);
+          int32_t v2c = *(m2c+step_size*i2c+1);
+
+          // if disparity is positive
+          if (u1c>=u2c) {
+            candidate[i1c] = Matcher::p_match(-1,-1,-1,-1,-1,-1,u1c,v1c,i1c,u2c,v2c,i2c);
+            found[i1c] = 1;
           }
         }
       }
+    });
+
+    // add match if this pixel isn't matched yet (in order, as the sequential loop)
+    for (i1c=0; i1c<n1c; i1c++) {
+      if (!found[i1c]) continue;
+      u1c = (int32_t)candidate[i1c].u1c;
+      v1c = (int32_t)candidate[i1c].v1c;
+      if (*(M+getAddressOffsetImage(u1c,v1c,dims_c[0]))==0) {
+        p_matched.push_back(candidate[i1c]);
+        *(M+getAddressOffsetImage(u1c,v1c,dims_c[0])) = 1;
+      }
     }
     
   /////////////////////////////////////////////////////
@@ -1094,8 +1155,13 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
     createIndexVector(m1c,n1c,k1c,u_bin_num,v_bin_num);
     createIndexVector(m2c,n2c,k2c,u_bin_num,v_bin_num);
     
-    // for all points do
-    for (i1p=0; i1p<n1p; i1p++) {
+    // for all points do (in parallel, the index vectors are only read)
+    found.assign(n1p,0);
+    candidate.resize(n1p);
+    parallelRange(n1p,getNumThreads(n1p/256+1),[&](int32_t i_start,int32_t i_end) {
+    for (int32_t i1p=i_start; i1p<i_end; i1p++) {
+      int32_t i2p,i2c,i1c,i1p2;
+      int32_t u1p,v1p,u2p,v2p,u1c,v1c,u2c,v2c;
 
       // coordinates
       u1p = *(m1p+step_size*i1p+0);
@@ -1147,11 +1213,18 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
         if (u1p>=u2p && u1c>=u2c) {
           
           // add match
-          p_matched.push_back(Matcher::p_match(u1p,v1p,i1p,u2p,v2p,i2p,
-                                               u1c,v1c,i1c,u2c,v2c,i2c));
+          candidate[i1p] = Matcher::p_match(u1p,v1p,i1p,u2p,v2p,i2p,
+                                            u1c,v1c,i1c,u2c,v2c,i2c);
+          found[i1p] = 1;
         }
       }
     }
+    });
+
+    // add matches in order, as the sequential loop
+    for (i1p=0; i1p<n1p; i1p++)
+      if (found[i1p])
+        p_matched.push_back(candidate[i1p]);
     
     // old version:
     /*
@@ -50,6 +50,7 @@ public:
     int32_t multi_stage;            // 0=disabled,1=multistage matching (denser and faster)
     int32_t half_resolution;        // 0=disabled,1=match at half resolution, refine at full resolution
     int32_t refinement;             // refinement (0=none,1=pixel,2=subpixel)
+    int32_t num_threads;            // left/right features and matching in parallel (0=hardware concurrency,1=sequential)
     double  f,cu,cv,base;           // calibration (only for match prediction)
     
     // default settings
@@ -64,6 +65,7 @@ public:
       multi_stage            = 1;
       half_resolution        = 1;
       refinement             = 1;
+      num_threads            = 0;
     }
   };
 
@@ -194,6 +196,9 @@ private:
   // WARNING: max,I_du,I_dv has to be freed by yourself!
   void computeFeatures (uint8_t *I,const int32_t* dims,int32_t* &max1,int32_t &num1,int32_t* &max2,int32_t &num2,uint8_t* &I_du,uint8_t* &I_dv,uint8_t* &I_du_full,uint8_t* &I_dv_full);
 
+  // number of threads used for n independent items
+  int32_t getNumThreads (int32_t n);
+
   // matching functions
   void computePriorStatistics (std::vector<Matcher::p_match> &p_matched,int32_t method);
   void createIndexVector (int32_t* m,int32_t n,std::vector<int32_t> *k,const int32_t &u_bin_num,const int32_t &v_bin_num);
@@ -0,0 +1,148 @@
+#ifndef MATRIX_FIXED_H
+#define MATRIX_FIXED_H
+
+#include <math.h>
+#include "matrix.h"
+
+// Compile-time sized counterpart of Matrix for the small matrices of the odometry and
+// reconstruction inner loops (3x3, 4x4, 6x6 normal equations). The values live in the
+// object itself, so temporaries don't touch the heap. Same conventions as Matrix:
+// row major 'val', solve() replaces *this by the solution and A by garbage.
+template<int32_t M,int32_t N>
+class FixedMatrix {
+
+public:
+
+  FixedMatrix () { zero(); }
+
+  // copies the top left MxN block of A (A must be at least MxN)
+  explicit FixedMatrix (const Matrix &A) {
+    for (int32_t i=0; i<M; i++)
+      for (int32_t j=0; j<N; j++)
+        val[i][j] = A.val[i][j];
+  }
+
+  Matrix toMatrix () const {
+    return Matrix(M,N,&val[0][0]);
+  }
+
+  void zero () {
+    for (int32_t i=0; i<M; i++)
+      for (int32_t j=0; j<N; j++)
+        val[i][j] = 0;
+  }
+
+  static FixedMatrix eye () {
+    FixedMatrix I;
+    for (int32_t i=0; i<M && i<N; i++)
+      I.val[i][i] = 1;
+    return I;
+  }
+
+  template<int32_t P>
+  FixedMatrix<M,P> operator* (const FixedMatrix<N,P> &B) const {
+    FixedMatrix<M,P> C;
+    for (int32_t i=0; i<M; i++)
+      for (int32_t j=0; j<P; j++) {
+        FLOAT c = 0;
+        for (int32_t k=0; k<N; k++)
+          c += val[i][k]*B.val[k][j];
+        C.val[i][j] = c;
+      }
+    return C;
+  }
+
+  FixedMatrix<N,M> operator~ () const {
+    FixedMatrix<N,M> T;
+    for (int32_t i=0; i<M; i++)
+      for (int32_t j=0; j<N; j++)
+        T.val[j][i] = val[i][j];
+    return T;
+  }
+
+  // solve A*x=B with Gauss-Jordan elimination and full pivoting (as Matrix::solve),
+  // *this is B (MxN) and becomes x. returns false if A is singular.
+  bool solve (FixedMatrix<M,M> &A,FLOAT eps=1e-20) {
+    int32_t indxc[M],indxr[M],ipiv[M];
+    int32_t icol=0,irow=0;
+    for (int32_t j=0; j<M; j++) ipiv[j]=0;
+
+    // main loop over the columns to be reduced
+    for (int32_t i=0; i<M; i++) {
+
+      // search for a pivot element
+      FLOAT big=0.0;
+      for (int32_t j=0; j<M; j++)
+        if (ipiv[j]!=1)
+          for (int32_t k=0; k<M; k++)
+            if (ipiv[k]==0 && fabs(A.val[j][k])>=big) {
+              big=fabs(A.val[j][k]);
+              irow=j;
+              icol=k;
+            }
+      ++(ipiv[icol]);
+
+      // put the pivot element on the diagonal
+      if (irow != icol) {
+        for (int32_t l=0; l<M; l++) swap(A.val[irow][l],A.val[icol][l]);
+        for (int32_t l=0; l<N; l++) swap(val[irow][l],val[icol][l]);
+      }
+      indxr[i]=irow;
+      indxc[i]=icol;
+
+      // check for singularity
+      if (fabs(A.val[icol][icol]) < eps)
+        return false;
+
+      FLOAT pivinv=1.0/A.val[icol][icol];
+      A.val[icol][icol]=1.0;
+      for (int32_t l=0; l<M; l++) A.val[icol][l] *= pivinv;
+      for (int32_t l=0; l<N; l++) val[icol][l] *= pivinv;
+
+      // reduce the rows except for the pivot one
+      for (int32_t ll=0; ll<M; ll++)
+        if (ll!=icol) {
+          FLOAT dum = A.val[ll][icol];
+          A.val[ll][icol] = 0.0;
+          for (int32_t l=0; l<M; l++) A.val[ll][l] -= A.val[icol][l]*dum;
+          for (int32_t l=0; l<N; l++) val[ll][l] -= val[icol][l]*dum;
+        }
+    }
+
+    // unscramble the column interchanges
+    for (int32_t l=M-1; l>=0; l--) {
+      if (indxr[l]!=indxc[l])
+        for (int32_t k=0; k<M; k++)
+          swap(A.val[k][indxr[l]],A.val[k][indxc[l]]);
+    }
+    return true;
+  }
+
+  // direct data access
+  FLOAT val[M][N];
+
+private:
+
+  static void swap (FLOAT &a,FLOAT &b) { FLOAT t=a; a=b; b=t; }
+
+};
+
+typedef FixedMatrix<3,3> Matrix33;
+typedef FixedMatrix<4,4> Matrix44;
+typedef FixedMatrix<6,6> Matrix66;
+typedef FixedMatrix<3,1> Vector3;
+typedef FixedMatrix<6,1> Vector6;
+
+// inverse of a rigid transformation [R t; 0 1] -> [R' -R'*t; 0 1]
+inline Matrix44 invRigid (const Matrix44 &T) {
+  Matrix44 Ti;
+  for (int32_t i=0; i<3; i++) {
+    for (int32_t j=0; j<3; j++)
+      Ti.val[i][j] = T.val[j][i];
+    Ti.val[i][3] = -(T.val[0][i]*T.val[0][3]+T.val[1][i]*T.val[1][3]+T.val[2][i]*T.val[2][3]);
+  }
+  Ti.val[3][3] = 1;
+  return Ti;
+}
+
+#endif // MATRIX_FIXED_H
@@ -276,8 +276,8 @@ Reconstruction::result Reconstruction::updatePoint(const track &t,point3d &p,con
     return FAILED;
   
   // init
-  Matrix A(3,3);
-  Matrix B(3,1);
+  Matrix33 A;
+  Vector3  B;
 
   // fill matrices A and B
   for (int32_t m=0; m<3; m++) {
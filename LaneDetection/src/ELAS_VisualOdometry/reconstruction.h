@@ -31,6 +31,7 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 
 #include "matcher.h"
 #include "matrix.h"
+#include "matrix_fixed.h"
 
 class Reconstruction {
 
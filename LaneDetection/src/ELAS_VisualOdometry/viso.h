@@ -83,7 +83,7 @@ public:
   // note: getMotion() returns the last transformation even when process()
   // has failed. this is useful if you wish to linearly extrapolate occasional
   // frames for which no correspondences have been found
-  Matrix getMotion () { return Tr_delta; }
+  const Matrix& getMotion () { return Tr_delta; }
 
   // returns previous to current feature matches from internal matcher
   std::vector<Matcher::p_match> getMatches () { return matcher->getMatches(); }
@@ -21,6 +21,11 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 
 #include "viso_stereo.h"
 
+#include <math.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
 using namespace std;
 
 VisualOdometryStereo::VisualOdometryStereo (parameters param) : param(param), VisualOdometry(param) {
@@ -51,6 +56,23 @@ bool VisualOdometryStereo::process (uint8_t *I1,uint8_t *I2,int32_t* dims,bool r
   return updateMotion();
 }
 
+struct VisualOdometryStereo::ransac_state {
+  vector<Matcher::p_match> *p_matched;
+  vector<int32_t>  samples;     // 3 indices per hypothesis, drawn before the threads start
+  int32_t          num_hyp;
+  int32_t          batch;
+  double           confidence;
+  vector<int32_t>  num_inlier;  // per hypothesis, -1 = failed or preempted
+  vector<double>   tr;          // 6 parameters per hypothesis
+  vector<int32_t>  batch_done;  // finished hypotheses per batch
+  atomic<int32_t>  next;        // next hypothesis to be claimed by a thread
+  atomic<int32_t>  stop;        // hypotheses >= stop are not started (early termination)
+  atomic<int32_t>  best_count;  // inliers of best_hyp, lower bound for preemptive scoring
+  mutex            mtx;         // protects batch_done, committed and best_hyp
+  int32_t          committed;   // batches merged in order
+  int32_t          best_hyp;    // best hypothesis of the committed batches (-1 = none)
+};
+
 vector<double> VisualOdometryStereo::estimateMotion (vector<Matcher::p_match> p_matched) {
   
   // return value
@@ -69,14 +91,10 @@ vector<double> VisualOdometryStereo::estimateMotion (vector<Matcher::p_match> p_
   if (N<6)
     return vector<double>();
 
-  // allocate dynamic memory
-  X          = new double[N];
-  Y          = new double[N];
-  Z          = new double[N];
-  J          = new double[4*N*6];
-  p_predict  = new double[4*N];
-  p_observe  = new double[4*N];
-  p_residual = new double[4*N];
+  // 3d points and buffers are kept between frames
+  X.resize(N);
+  Y.resize(N);
+  Z.resize(N);
 
   // project matches of previous image into 3d
   for (int32_t i=0; i<N; i++) {
@@ -88,39 +106,46 @@ vector<double> VisualOdometryStereo::estimateMotion (vector<Matcher::p_match> p_
 
   // loop variables
   vector<double> tr_delta;
-  vector<double> tr_delta_curr;
-  tr_delta_curr.resize(6);
   
   // clear parameter vector
   inliers.clear();
 
-  // initial RANSAC estimate
-  for (int32_t k=0;k<param.ransac_iters;k++) {
-
-    // draw random sample set
+  // draw all random sample sets first, so that the result doesn't depend on the threads
+  ransac_state state;
+  state.p_matched  = &p_matched;
+  state.num_hyp    = max(param.ransac_iters,0);
+  state.batch      = max(param.ransac_batch,1);
+  state.confidence = param.ransac_confidence;
+  if (param.ransac_seed>=0)
+    srand(param.ransac_seed);
+  state.samples.resize(3*state.num_hyp);
+  for (int32_t k=0; k<state.num_hyp; k++) {
     vector<int32_t> active = getRandomSample(N,3);
-
-    // clear parameter vector
-    for (int32_t i=0; i<6; i++)
-      tr_delta_curr[i] = 0;
-
-    // minimize reprojection errors
-    VisualOdometryStereo::result result = UPDATED;
-    int32_t iter=0;
-    while (result==UPDATED) {
-      result = updateParameters(p_matched,active,tr_delta_curr,1,1e-6);
-      if (iter++ > 20 || result==CONVERGED)
-        break;
-    }
-
-    // overwrite best parameters if we have more inliers
-    if (result!=FAILED) {
-      vector<int32_t> inliers_curr = getInlier(p_matched,tr_delta_curr);
-      if (inliers_curr.size()>inliers.size()) {
-        inliers = inliers_curr;
-        tr_delta = tr_delta_curr;
-      }
-    }
+    for (int32_t i=0; i<3; i++)
+      state.samples[3*k+i] = active[i];
+  }
+  state.num_inlier.assign(state.num_hyp,-1);
+  state.tr.assign(6*state.num_hyp,0);
+  state.batch_done.assign((state.num_hyp+state.batch-1)/state.batch,0);
+  state.next       = 0;
+  state.stop       = state.num_hyp;
+  state.best_count = 0;
+  state.committed  = 0;
+  state.best_hyp   = -1;
+
+  // initial RANSAC estimate: hypotheses are scored in parallel and merged batch by batch
+  int32_t num_threads = param.ransac_threads>0 ? param.ransac_threads : (int32_t)thread::hardware_concurrency();
+  num_threads = max(1,min(num_threads,state.num_hyp));
+  vector<thread> workers;
+  for (int32_t t=1; t<num_threads; t++)
+    workers.push_back(thread(&VisualOdometryStereo::ransacWorker,this,ref(state)));
+  ransacWorker(state);
+  for (int32_t t=0; t<(int32_t)workers.size(); t++)
+    workers[t].join();
+
+  if (state.best_hyp>=0) {
+    tr_delta.assign(state.tr.begin()+6*state.best_hyp,state.tr.begin()+6*state.best_hyp+6);
+    inliers = getInlier(p_matched,tr_delta);
   }
   
   // final optimization (refinement)
@@ -128,7 +153,7 @@ vector<double> VisualOdometryStereo::estimateMotion (vector<Matcher::p_match> p_
     int32_t iter=0;
     VisualOdometryStereo::result result = UPDATED;
     while (result==UPDATED) {     
-      result = updateParameters(p_matched,inliers,tr_delta,1,1e-8);
+      result = updateParameters(p_matched,inliers,tr_delta,1,1e-8,ws);
       if (iter++ > 100 || result==CONVERGED)
         break;
     }
@@ -141,21 +166,83 @@ vector<double> VisualOdometryStereo::estimateMotion (vector<Matcher::p_match> p_
   } else {
     success = false;
   }
-
-  // release dynamic memory
-  delete[] X;
-  delete[] Y;
-  delete[] Z;
-  delete[] J;
-  delete[] p_predict;
-  delete[] p_observe;
-  delete[] p_residual;
   
   // parameter estimate succeeded?
   if (success) return tr_delta;
   else         return vector<double>();
 }
 
+void VisualOdometryStereo::ransacWorker (ransac_state &state) {
+
+  // scratch buffers of this thread
+  workspace ws_thread;
+  vector<int32_t> active(3);
+  vector<double> tr_delta_curr(6);
+  int32_t num_batches = state.batch_done.size();
+
+  while (true) {
+
+    // claim next hypothesis
+    int32_t k = state.next++;
+    if (k>=state.num_hyp || k>=state.stop)
+      break;
+
+    // sample set drawn beforehand
+    for (int32_t i=0; i<3; i++)
+      active[i] = state.samples[3*k+i];
+
+    // clear parameter vector
+    for (int32_t i=0; i<6; i++)
+      tr_delta_curr[i] = 0;
+
+    // minimize reprojection errors
+    VisualOdometryStereo::result result = UPDATED;
+    int32_t iter=0;
+    while (result==UPDATED) {
+      result = updateParameters(*state.p_matched,active,tr_delta_curr,1,1e-6,ws_thread);
+      if (iter++ > 20 || result==CONVERGED)
+        break;
+    }
+
+    // score: the bound comes from earlier batches only, a preempted hypothesis
+    // could not have more inliers than an earlier one, so the winner is the same
+    // as with a sequential loop
+    int32_t num_inlier = -1;
+    if (result!=FAILED)
+      num_inlier = countInlier(*state.p_matched,tr_delta_curr,state.best_count);
+    state.num_inlier[k] = num_inlier;
+    for (int32_t i=0; i<6; i++)
+      state.tr[6*k+i] = tr_delta_curr[i];
+
+    // merge finished batches in order (first best hypothesis wins, as sequential RANSAC)
+    lock_guard<mutex> lock(state.mtx);
+    state.batch_done[k/state.batch]++;
+    while (state.committed<num_batches && state.committed*state.batch<state.stop) {
+      int32_t b     = state.committed;
+      int32_t k_end = min((b+1)*state.batch,state.num_hyp);
+      if (state.batch_done[b]<k_end-b*state.batch)
+        break;
+      for (int32_t i=b*state.batch; i<k_end; i++) {
+        if (state.num_inlier[i]>state.best_count) {
+          state.best_count = state.num_inlier[i];
+          state.best_hyp   = i;
+        }
+      }
+      state.committed++;
+
+      // early termination: number of samples needed to draw 3 inliers with the given confidence
+      if (state.confidence>0 && state.best_count>0) {
+        double w3 = pow((double)state.best_count/(double)state.p_matched->size(),3);
+        double required = 0;
+        if (w3<1)
+          required = log(1-state.confidence)/log(1-w3);
+        if (state.committed*state.batch>=required)
+          state.stop = min((int32_t)state.stop,k_end);
+      }
+    }
+  }
+}
+
 vector<int32_t> VisualOdometryStereo::getInlier(vector<Matcher::p_match> &p_matched,vector<double> &tr) {
 
   // mark all observations active
@@ -164,47 +251,72 @@ vector<int32_t> VisualOdometryStereo::getInlier(vector<Matcher::p_match> &p_matc
     active.push_back(i);
 
   // extract observations and compute predictions
-  computeObservations(p_matched,active);
-  computeResidualsAndJacobian(tr,active);
+  ws.resize(active.size());
+  computeObservations(p_matched,active,ws);
+  computeResidualsAndJacobian(tr,active,ws);
 
   // compute inliers
   vector<int32_t> inliers;
   for (int32_t i=0; i<(int32_t)p_matched.size(); i++)
-    if (pow(p_observe[4*i+0]-p_predict[4*i+0],2)+pow(p_observe[4*i+1]-p_predict[4*i+1],2) +
-        pow(p_observe[4*i+2]-p_predict[4*i+2],2)+pow(p_observe[4*i+3]-p_predict[4*i+3],2) < param.inlier_threshold*param.inlier_threshold)
+    if (pow(ws.p_observe[4*i+0]-ws.p_predict[4*i+0],2)+pow(ws.p_observe[4*i+1]-ws.p_predict[4*i+1],2) +
+        pow(ws.p_observe[4*i+2]-ws.p_predict[4*i+2],2)+pow(ws.p_observe[4*i+3]-ws.p_predict[4*i+3],2) < param.inlier_threshold*param.inlier_threshold)
       inliers.push_back(i);
   return inliers;
 }
 
-VisualOdometryStereo::result VisualOdometryStereo::updateParameters(vector<Matcher::p_match> &p_matched,vector<int32_t> &active,vector<double> &tr,double step_size,double eps) {
+int32_t VisualOdometryStereo::countInlier(const vector<Matcher::p_match> &p_matched,const vector<double> &tr,int32_t bound) {
+
+  // same projection as computeResidualsAndJacobian(), without jacobian
+  double rx = tr[0]; double ry = tr[1]; double rz = tr[2];
+  double tx = tr[3]; double ty = tr[4]; double tz = tr[5];
+  double sx = sin(rx); double cx = cos(rx); double sy = sin(ry);
+  double cy = cos(ry); double sz = sin(rz); double cz = cos(rz);
+  double r00 = +cy*cz;          double r01 = -cy*sz;          double r02 = +sy;
+  double r10 = +sx*sy*cz+cx*sz; double r11 = -sx*sy*sz+cx*cz; double r12 = -sx*cy;
+  double r20 = -cx*sy*cz+sx*sz; double r21 = +cx*sy*sz+sx*cz; double r22 = +cx*cy;
+
+  double f  = param.calib.f;
+  double cu = param.calib.cu;
+  double cv = param.calib.cv;
+  double threshold = param.inlier_threshold*param.inlier_threshold;
+
+  int32_t N = p_matched.size();
+  int32_t num_inlier = 0;
+  for (int32_t i=0; i<N; i++) {
+
+    // preemption: even if all remaining points are inliers, bound is not exceeded
+    if (num_inlier+N-i<=bound)
+      return -1;
+
+    double X1c = r00*X[i]+r01*Y[i]+r02*Z[i]+tx;
+    double Y1c = r10*X[i]+r11*Y[i]+r12*Z[i]+ty;
+    double Z1c = r20*X[i]+r21*Y[i]+r22*Z[i]+tz;
+    double X2c = X1c-param.base;
+
+    double du1 = p_matched[i].u1c-(f*X1c/Z1c+cu);
+    double dv1 = p_matched[i].v1c-(f*Y1c/Z1c+cv);
+    double du2 = p_matched[i].u2c-(f*X2c/Z1c+cu);
+    double dv2 = p_matched[i].v2c-(f*Y1c/Z1c+cv);
+    if (du1*du1+dv1*dv1+du2*du2+dv2*dv2<threshold)
+      num_inlier++;
+  }
+  return num_inlier;
+}
+
+VisualOdometryStereo::result VisualOdometryStereo::updateParameters(vector<Matcher::p_match> &p_matched,vector<int32_t> &active,vector<double> &tr,double step_size,double eps,workspace &ws) {
   
   // we need at least 3 observations
   if (active.size()<3)
     return FAILED;
   
   // extract observations and compute predictions
-  computeObservations(p_matched,active);
-  computeResidualsAndJacobian(tr,active);
-
-  // init
-  Matrix A(6,6);
-  Matrix B(6,1);
-
-  // fill matrices A and B
-  for (int32_t m=0; m<6; m++) {
-    for (int32_t n=0; n<6; n++) {
-      double a = 0;
-      for (int32_t i=0; i<4*(int32_t)active.size(); i++) {
-        a += J[i*6+m]*J[i*6+n];
-      }
-      A.val[m][n] = a;
-    }
-    double b = 0;
-    for (int32_t i=0; i<4*(int32_t)active.size(); i++) {
-      b += J[i*6+m]*(p_residual[i]);
-    }
-    B.val[m][0] = b;
-  }
+  ws.resize(active.size());
+  computeObservations(p_matched,active,ws);
+  computeResidualsAndJacobian(tr,active,ws);
+
+  // normal equations (solve() overwrites them)
+  Matrix66 A = ws.JtJ;
+  Vector6  B = ws.Jtr;
 
   // perform elimination
   if (B.solve(A)) {
@@ -223,7 +335,9 @@ VisualOdometryStereo::result VisualOdometryStereo::updateParameters(vector<Match
   }
 }
 
-void VisualOdometryStereo::computeObservations(vector<Matcher::p_match> &p_matched,vector<int32_t> &active) {
+void VisualOdometryStereo::computeObservations(vector<Matcher::p_match> &p_matched,vector<int32_t> &active,workspace &ws) {
+
+  double *p_observe = &ws.p_observe[0];
 
   // set all observations
   for (int32_t i=0; i<(int32_t)active.size(); i++) {
@@ -234,7 +348,12 @@ void VisualOdometryStereo::computeObservations(vector<Matcher::p_match> &p_match
   }
 }
 
-void VisualOdometryStereo::computeResidualsAndJacobian(vector<double> &tr,vector<int32_t> &active) {
+void VisualOdometryStereo::computeResidualsAndJacobian(vector<double> &tr,vector<int32_t> &active,workspace &ws) {
+
+  // buffers of the calling thread
+  double *p_observe  = &ws.p_observe[0];
+  double *p_predict  = &ws.p_predict[0];
+  double *p_residual = &ws.p_residual[0];
 
   // extract motion parameters
   double rx = tr[0]; double ry = tr[1]; double rz = tr[2];
@@ -261,6 +380,11 @@ void VisualOdometryStereo::computeResidualsAndJacobian(vector<double> &tr,vector
   double X1p,Y1p,Z1p;
   double X1c,Y1c,Z1c,X2c;
   double X1cd,Y1cd,Z1cd;
+  double J[4*6]; // jacobian rows of the current observation
+
+  // the full jacobian is never stored, J'*J and J'*r are accumulated instead
+  ws.JtJ.zero();
+  ws.Jtr.zero();
 
   // for all observations do
   for (int32_t i=0; i<(int32_t)active.size(); i++) {
@@ -306,10 +430,10 @@ void VisualOdometryStereo::computeResidualsAndJacobian(vector<double> &tr,vector
       }
 
       // set jacobian entries (project via K)
-      J[(4*i+0)*6+j] = weight*param.calib.f*(X1cd*Z1c-X1c*Z1cd)/(Z1c*Z1c); // left u'
-      J[(4*i+1)*6+j] = weight*param.calib.f*(Y1cd*Z1c-Y1c*Z1cd)/(Z1c*Z1c); // left v'
-      J[(4*i+2)*6+j] = weight*param.calib.f*(X1cd*Z1c-X2c*Z1cd)/(Z1c*Z1c); // right u'
-      J[(4*i+3)*6+j] = weight*param.calib.f*(Y1cd*Z1c-Y1c*Z1cd)/(Z1c*Z1c); // right v'
+      J[0*6+j] = weight*param.calib.f*(X1cd*Z1c-X1c*Z1cd)/(Z1c*Z1c); // left u'
+      J[1*6+j] = weight*param.calib.f*(Y1cd*Z1c-Y1c*Z1cd)/(Z1c*Z1c); // left v'
+      J[2*6+j] = weight*param.calib.f*(X1cd*Z1c-X2c*Z1cd)/(Z1c*Z1c); // right u'
+      J[3*6+j] = weight*param.calib.f*(Y1cd*Z1c-Y1c*Z1cd)/(Z1c*Z1c); // right v'
     }
 
     // set prediction (project via K)
@@ -323,6 +447,21 @@ void VisualOdometryStereo::computeResidualsAndJacobian(vector<double> &tr,vector
     p_residual[4*i+1] = weight*(p_observe[4*i+1]-p_predict[4*i+1]);
     p_residual[4*i+2] = weight*(p_observe[4*i+2]-p_predict[4*i+2]);
     p_residual[4*i+3] = weight*(p_observe[4*i+3]-p_predict[4*i+3]);
+
+    // accumulate normal equations (upper triangle, same summation order as J'*J)
+    for (int32_t k=0; k<4; k++) {
+      const double *Jk = J+k*6;
+      for (int32_t m=0; m<6; m++) {
+        for (int32_t n=m; n<6; n++)
+          ws.JtJ.val[m][n] += Jk[m]*Jk[n];
+        ws.Jtr.val[m][0] += Jk[m]*p_residual[4*i+k];
+      }
+    }
   }
+
+  // lower triangle
+  for (int32_t m=1; m<6; m++)
+    for (int32_t n=0; n<m; n++)
+      ws.JtJ.val[m][n] = ws.JtJ.val[n][m];
 }
 
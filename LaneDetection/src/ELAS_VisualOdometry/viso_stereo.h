@@ -23,6 +23,7 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #define VISO_STEREO_H
 
 #include "viso.h"
+#include "matrix_fixed.h"
 
 class VisualOdometryStereo : public VisualOdometry {
 
@@ -30,15 +31,23 @@ public:
 
   // stereo-specific parameters (mandatory: base)
   struct parameters : public VisualOdometry::parameters {
-    double  base;             // baseline (meters)
-    int32_t ransac_iters;     // number of RANSAC iterations
-    double  inlier_threshold; // fundamental matrix inlier threshold
-    bool    reweighting;      // lower border weights (more robust to calibration errors)
+    double  base;              // baseline (meters)
+    int32_t ransac_iters;      // number of RANSAC iterations
+    double  inlier_threshold;  // fundamental matrix inlier threshold
+    bool    reweighting;       // lower border weights (more robust to calibration errors)
+    int32_t ransac_threads;    // threads scoring RANSAC hypotheses (0 = hardware concurrency)
+    int32_t ransac_batch;      // hypotheses per batch, early termination is checked between batches
+    double  ransac_confidence; // stop once a better hypothesis is unlikely with this confidence (0 = run all iterations)
+    int32_t ransac_seed;       // >=0: reseed the sample generator every frame (reproducible poses), -1: keep rand() state
     parameters () {
-      base             = 1.0;
-      ransac_iters     = 200;
-      inlier_threshold = 2.0;
-      reweighting      = true;
+      base              = 1.0;
+      ransac_iters      = 200;
+      inlier_threshold  = 2.0;
+      reweighting       = true;
+      ransac_threads    = 0;
+      ransac_batch      = 16;
+      ransac_confidence = 0.999;
+      ransac_seed       = -1;
     }
   };
 
@@ -68,15 +77,36 @@ public:
 
 private:
 
+  // buffers of one least squares problem, each RANSAC thread owns one
+  struct workspace {
+    Matrix66            JtJ;        // normal equations J'*J, accumulated point by point
+    Vector6             Jtr;        // J'*p_residual
+    std::vector<double> p_observe;  // observed 2d points
+    std::vector<double> p_predict;  // predicted 2d points
+    std::vector<double> p_residual; // residuals (p_residual=p_observe-p_predict)
+    void resize (int32_t num_active) {
+      if ((int32_t)p_observe.size()<4*num_active) {
+        p_observe.resize(4*num_active);
+        p_predict.resize(4*num_active);
+        p_residual.resize(4*num_active);
+      }
+    }
+  };
+
+  // shared state of the parallel RANSAC
+  struct ransac_state;
+
   std::vector<double>  estimateMotion (std::vector<Matcher::p_match> p_matched);
   enum                 result { UPDATED, FAILED, CONVERGED };  
-  result               updateParameters(std::vector<Matcher::p_match> &p_matched,std::vector<int32_t> &active,std::vector<double> &tr,double step_size,double eps);
-  void                 computeObservations(std::vector<Matcher::p_match> &p_matched,std::vector<int32_t> &active);
-  void                 computeResidualsAndJacobian(std::vector<double> &tr,std::vector<int32_t> &active);
+  result               updateParameters(std::vector<Matcher::p_match> &p_matched,std::vector<int32_t> &active,std::vector<double> &tr,double step_size,double eps,workspace &ws);
+  void                 computeObservations(std::vector<Matcher::p_match> &p_matched,std::vector<int32_t> &active,workspace &ws);
+  void                 computeResidualsAndJacobian(std::vector<double> &tr,std::vector<int32_t> &active,workspace &ws);
   std::vector<int32_t> getInlier(std::vector<Matcher::p_match> &p_matched,std::vector<double> &tr);
+  int32_t              countInlier(const std::vector<Matcher::p_match> &p_matched,const std::vector<double> &tr,int32_t bound);
+  void                 ransacWorker(ransac_state &state);
 
-  double *X,*Y,*Z;    // 3d points
-  double *p_residual; // residuals (p_residual=p_observe-p_predict)
+  std::vector<double> X,Y,Z; // 3d points
+  workspace           ws;    // buffers of the final refinement
   
   // parameters
   parameters param;
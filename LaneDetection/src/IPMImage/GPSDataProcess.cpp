@@ -1,9 +1,10 @@
 #include "IPMImage.h"
+#include "..\KITTI_Data_Reader\OxtsIndex.h"
 
 #define PI_180 CV_PI/180
 #define RADIANEARTH 6378137
 
-void InterfaceProcessIPMImage::initRotationGPS(Oxts_Data_Type *oxtsData)
+void InterfaceProcessIPMImage::initRotationGPS(const Oxts_Data_Type *oxtsData)
 {
 	r = RADIANEARTH;
 	s = cos(oxtsData->lat*PI_180);
@@ -25,11 +26,12 @@ void InterfaceProcessIPMImage::initRotationGPS(Oxts_Data_Type *oxtsData)
 }
 
 
-void InterfaceProcessIPMImage::drawVehiclePosition(Oxts_Data_Type *oxtsData)
+void InterfaceProcessIPMImage::drawVehiclePosition(const Oxts_Data_Type *oxtsData)
 {
 	if (rotation_gps.empty())
 	{
-		initRotationGPS(oxtsData);
+		const Oxts_Data_Type *first = oxtsIndex ? oxtsIndex->getOxts(0) : NULL;
+		initRotationGPS(first ? first : oxtsData);
 	}
 
 	double gps_x = r * oxtsData->lon * PI_180 - gpsData0[0];
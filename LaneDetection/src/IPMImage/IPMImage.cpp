@@ -1,10 +1,20 @@
 #include "IPMImage.h"
+#include "RoadMosaic.h"
+#include <cfloat>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define IPM_USE_SSE2
+#endif
 
 
 InterfaceProcessIPMImage::InterfaceProcessIPMImage(){
 	ipm = new InversePerspectiveMapping();
 	showInfoVISO = false;
 	showInfoGPS = false;
+	gather = false;
+	mosaic = NULL;
+	oxtsIndex = NULL;
 }
 
 
@@ -18,6 +28,9 @@ InterfaceProcessIPMImage::InterfaceProcessIPMImage(Calib_Data_Type calibData, do
 		(IPM_X_MAX - IPM_X_MIN) * IPM_IMAGE_SIZE_SCALE, CV_8UC1);
 	showInfoVISO = false;
 	showInfoGPS = false;
+	gather = false;
+	mosaic = NULL;
+	oxtsIndex = NULL;
 }
 
 InterfaceProcessIPMImage::InterfaceProcessIPMImage(Calib_Data_Type calibData, double h, const Mat &disp){
@@ -30,6 +43,9 @@ InterfaceProcessIPMImage::InterfaceProcessIPMImage(Calib_Data_Type calibData, do
 		(IPM_X_MAX - IPM_X_MIN) * IPM_IMAGE_SIZE_SCALE, CV_8UC1);
 	showInfoVISO = false;
 	showInfoGPS = false;
+	gather = false;
+	mosaic = NULL;
+	oxtsIndex = NULL;
 }
 
 void InterfaceProcessIPMImage::showVehiclePosition(bool infoVISO, bool infoGPS)
@@ -39,7 +55,7 @@ void InterfaceProcessIPMImage::showVehiclePosition(bool infoVISO, bool infoGPS)
 }
 
 void InterfaceProcessIPMImage::processIPM(const Mat &image, const Mat &pose, Mat &outIPMImage, Mat &IPMImageMask,
-	Oxts_Data_Type *gpsData)
+	const Oxts_Data_Type *gpsData)
 {
 	ipm->updateFrameUsingStandardAssumption(pose);
 
@@ -49,7 +65,22 @@ void InterfaceProcessIPMImage::processIPM(const Mat &image, const Mat &pose, Mat
 	else
 		image.copyTo(grayImage);
 
+	if (mosaic != NULL)
+		mosaic->addFrame(grayImage, ipm->getWorldToImage(), pose.at<double>(0, 3), pose.at<double>(2, 3));
+
 	Mat mask = Mat::zeros(ipmImage.size(), CV_8UC1);
+	if (gather)
+	{
+		gatherIPMImage(grayImage, mask);
+
+		if (showInfoGPS && (gpsData != NULL))
+			drawVehiclePosition(gpsData);
+
+		ipmImage.copyTo(outIPMImage);
+		mask.copyTo(IPMImageMask);
+		return;
+	}
+
 	for (int i = 0; i < height; i++)
 	{
 		if (i < height / 2) continue;
@@ -118,6 +149,158 @@ void InterfaceProcessIPMImage::processIPM(const Mat &image, const Mat &pose, Mat
 	mask.copyTo(IPMImageMask);
 }
 
+//rows of a ground grid : projection of the cells, then bilinear or footprint mean.
+//M : world (X, 0, Z) to image, z(0) * [u;v;1;1/z(0)] = M * [X; 0; Z; 1]
+class IPMGatherBody : public ParallelLoopBody {
+public:
+	IPMGatherBody(const Mat &_gray, const Mat &_sum, const double *_M, const InterfaceProcessIPMImage::GroundGrid &_grid,
+		Mat &_ipmImage, Mat &_mask) :
+		gray(_gray), sum(_sum), M(_M), grid(_grid), ipmImage(_ipmImage), mask(_mask) {}
+
+	void operator()(const Range &range) const
+	{
+		int cols = ipmImage.cols;
+		float cell_x = (float)grid.cell_x;
+		float cell_z = (float)grid.cell_z;
+		float max_depth = grid.max_depth > 0 ? (float)grid.max_depth : FLT_MAX;
+		//the scatter mode only uses the lower half of the image
+		float u_max = (float)(gray.cols - 1), v_min = (float)(gray.rows / 2), v_max = (float)(gray.rows - 1);
+
+		std::vector<float> U(cols), V(cols), HU(cols), HV(cols), D(cols);
+		for (int r = range.start; r < range.end; r++)
+		{
+			//same cells as XZtoIPMImage
+			float Z = (float)(grid.z_min + (ipmImage.rows - 1 - r) * grid.cell_z);
+			projectRow(Z, cell_x, cell_z, cols, &U[0], &V[0], &HU[0], &HV[0], &D[0]);
+
+			uchar *ptr_row_ipm_image = ipmImage.ptr<uchar>(r);
+			uchar *ptr_row_mask = mask.empty() ? NULL : mask.ptr<uchar>(r);
+			for (int c = 0; c < cols; c++)
+			{
+				float u = U[c], v = V[c];
+				if (!(u >= 0 && u <= u_max && v >= v_min && v <= v_max) || D[c] > max_depth)
+					continue;
+
+				float value;
+				if (HU[c] <= 1 && HV[c] <= 1)
+					value = bilinear(u, v);
+				else
+					value = footprintMean(u, v, HU[c], HV[c]);
+
+				if (ptr_row_mask != NULL)
+					ptr_row_mask[c] = 255;
+				uchar g = (uchar)(value + 0.5f);
+				if (ptr_row_ipm_image[c] == 0)
+					ptr_row_ipm_image[c] = g;
+				else
+					ptr_row_ipm_image[c] = 0.5 * ptr_row_ipm_image[c] + 0.5 * g;
+			}
+		}
+	}
+
+private:
+	//(u, v) of the cells of a row, half size (HU, HV) in pixels of their footprint and depth D, u = v = -1 behind the camera
+	void projectRow(float Z, float cell_x, float cell_z, int cols, float *U, float *V, float *HU, float *HV, float *D) const
+	{
+		//numerators and depth are affine in X along the row
+		double x_min = grid.x_min;
+		float nu0 = (float)(M[0] * x_min + M[2] * Z + M[3]), nu1 = (float)(M[0] * cell_x);
+		float nv0 = (float)(M[4] * x_min + M[6] * Z + M[7]), nv1 = (float)(M[4] * cell_x);
+		float d0 = (float)(M[8] * x_min + M[10] * Z + M[11]), d1 = (float)(M[8] * cell_x);
+		//derivatives of u, v along X and Z times half a cell : (m - u m8) / d
+		float ax = 0.5f * cell_x, az = 0.5f * cell_z;
+		float m0 = (float)M[0], m2 = (float)M[2], m4 = (float)M[4], m6 = (float)M[6];
+		float m8 = (float)M[8], m10 = (float)M[10];
+
+		int c = 0;
+#ifdef IPM_USE_SSE2
+		const __m128 zero = _mm_setzero_ps(), minus_one = _mm_set1_ps(-1.f);
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		for (; c + 4 <= cols; c += 4)
+		{
+			__m128 k = _mm_setr_ps((float)c, (float)(c + 1), (float)(c + 2), (float)(c + 3));
+			__m128 d = _mm_add_ps(_mm_set1_ps(d0), _mm_mul_ps(_mm_set1_ps(d1), k));
+			__m128 front = _mm_cmpgt_ps(d, zero);
+			__m128 inv_d = _mm_div_ps(_mm_set1_ps(1.f), _mm_or_ps(_mm_and_ps(front, d), _mm_andnot_ps(front, _mm_set1_ps(1.f))));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(nu0), _mm_mul_ps(_mm_set1_ps(nu1), k)), inv_d);
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(nv0), _mm_mul_ps(_mm_set1_ps(nv1), k)), inv_d);
+			__m128 dux = _mm_and_ps(abs_mask, _mm_sub_ps(_mm_set1_ps(m0), _mm_mul_ps(u, _mm_set1_ps(m8))));
+			__m128 duz = _mm_and_ps(abs_mask, _mm_sub_ps(_mm_set1_ps(m2), _mm_mul_ps(u, _mm_set1_ps(m10))));
+			__m128 dvx = _mm_and_ps(abs_mask, _mm_sub_ps(_mm_set1_ps(m4), _mm_mul_ps(v, _mm_set1_ps(m8))));
+			__m128 dvz = _mm_and_ps(abs_mask, _mm_sub_ps(_mm_set1_ps(m6), _mm_mul_ps(v, _mm_set1_ps(m10))));
+			__m128 hu = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dux, _mm_set1_ps(ax)), _mm_mul_ps(duz, _mm_set1_ps(az))), inv_d);
+			__m128 hv = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dvx, _mm_set1_ps(ax)), _mm_mul_ps(dvz, _mm_set1_ps(az))), inv_d);
+			_mm_storeu_ps(U + c, _mm_or_ps(_mm_and_ps(front, u), _mm_andnot_ps(front, minus_one)));
+			_mm_storeu_ps(V + c, _mm_or_ps(_mm_and_ps(front, v), _mm_andnot_ps(front, minus_one)));
+			_mm_storeu_ps(HU + c, hu);
+			_mm_storeu_ps(HV + c, hv);
+			_mm_storeu_ps(D + c, d);
+		}
+#endif
+		for (; c < cols; c++)
+		{
+			float d = d0 + d1 * c;
+			D[c] = d;
+			if (d <= 0)
+			{
+				U[c] = V[c] = -1;
+				HU[c] = HV[c] = 0;
+				continue;
+			}
+			float u = (nu0 + nu1 * c) / d, v = (nv0 + nv1 * c) / d;
+			U[c] = u;
+			V[c] = v;
+			HU[c] = (std::abs(m0 - u * m8) * ax + std::abs(m2 - u * m10) * az) / d;
+			HV[c] = (std::abs(m4 - v * m8) * ax + std::abs(m6 - v * m10) * az) / d;
+		}
+	}
+
+	float bilinear(float u, float v) const
+	{
+		int u0 = std::min((int)u, gray.cols - 2), v0 = std::min((int)v, gray.rows - 2);
+		float fu = u - u0, fv = v - v0;
+		const uchar *p0 = gray.ptr<uchar>(v0) + u0;
+		const uchar *p1 = gray.ptr<uchar>(v0 + 1) + u0;
+		return (1 - fv) * ((1 - fu) * p0[0] + fu * p0[1]) + fv * ((1 - fu) * p1[0] + fu * p1[1]);
+	}
+
+	//mean of the pixels of [u - hu, u + hu] x [v - hv, v + hv] with the integral image
+	float footprintMean(float u, float v, float hu, float hv) const
+	{
+		int u0 = std::max(0, (int)(u - hu + 0.5f)), u1 = std::min(gray.cols, (int)(u + hu + 0.5f) + 1);
+		int v0 = std::max(0, (int)(v - hv + 0.5f)), v1 = std::min(gray.rows, (int)(v + hv + 0.5f) + 1);
+		const int *s0 = sum.ptr<int>(v0), *s1 = sum.ptr<int>(v1);
+		int total = s1[u1] - s1[u0] - s0[u1] + s0[u0];
+		return (float)total / ((u1 - u0) * (v1 - v0));
+	}
+
+	const Mat &gray;
+	const Mat &sum;
+	const double *M;
+	const InterfaceProcessIPMImage::GroundGrid &grid;
+	Mat &ipmImage;
+	Mat &mask;
+};
+
+void InterfaceProcessIPMImage::gatherGround(const Mat &grayImage, const Mat &sum, const double *M, const GroundGrid &grid,
+	Mat &groundImage, Mat &mask)
+{
+	parallel_for_(Range(0, groundImage.rows), IPMGatherBody(grayImage, sum, M, grid, groundImage, mask));
+}
+
+void InterfaceProcessIPMImage::gatherIPMImage(const Mat &grayImage, Mat &mask)
+{
+	Mat sum;
+	integral(grayImage, sum, CV_32S);
+	GroundGrid grid;
+	grid.x_min = IPM_X_MIN;
+	grid.z_min = IPM_Z_MIN;
+	grid.cell_x = (double)(IPM_X_MAX - IPM_X_MIN) / ipmImage.cols;
+	grid.cell_z = (double)(IPM_Z_MAX - IPM_Z_MIN) / ipmImage.rows;
+	grid.max_depth = 0;
+	gatherGround(grayImage, sum, ipm->getWorldToImage(), grid, ipmImage, mask);
+}
+
 void InterfaceProcessIPMImage::XZtoIPMImage(double X, double Z, double &r, double &c){
 	r = (Z - IPM_Z_MIN) * ((float)ipmImage.rows) / (IPM_Z_MAX - IPM_Z_MIN);
 	r = ipmImage.rows - r - 1;
@@ -129,7 +312,7 @@ void InterfaceProcessIPMImage::IPMImageUVtoXZ(int r, int c, double &X, double &Z
 }
 
 void InterfaceProcessIPMImage::processIPM(const Mat &image, const Matrix &pose, Mat &IPMImage, Mat &IPMImageMask,
-	Oxts_Data_Type *gpsData)
+	const Oxts_Data_Type *gpsData)
 {
 	Mat mat_pose = Mat::eye(pose.m, pose.n, CV_64FC1);
 	double* ptr_mat_pose = mat_pose.ptr<double>(0);
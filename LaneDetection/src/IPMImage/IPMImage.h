@@ -12,6 +12,9 @@ using namespace cv;
 #define IPM_X_MAX 10
 #define IPM_IMAGE_SIZE_SCALE 20
 
+class RoadMosaic;
+class OxtsIndex;
+
 class InterfaceProcessIPMImage{
 public:
 	InterfaceProcessIPMImage();
@@ -25,8 +28,31 @@ public:
 
 	void showVehiclePosition(bool infoVISO, bool infoGPS);
 
-	void processIPM(const Mat &image, const Mat &pose, Mat &IPMImage, Mat &IPMImageMask = Mat(), Oxts_Data_Type *gpsData = NULL);
-	void processIPM(const Mat &image, const Matrix &pose, Mat &IPMImage, Mat &IPMImageMask = Mat(), Oxts_Data_Type *gpsData = NULL);
+	//gather : each cell of the ipm image takes its value from its projection in the image
+	//(bilinear, or the mean of its footprint when it covers several pixels), by rows on all
+	//threads, without holes. Otherwise the pixels of the image are splat to the ipm image.
+	void setGatherMode(bool _gather) { gather = _gather; }
+
+	//every processed frame is also added to the mosaic (not owned), NULL : none
+	void setMosaic(RoadMosaic *_mosaic) { mosaic = _mosaic; }
+
+	//the gps positions are drawn from the first frame of the drive (not owned), e.g. the
+	//KITTI_Data_Reader::getOxtsIndex records passed to processIPM. NULL : from the first drawn frame
+	void setOxtsIndex(const OxtsIndex *_oxtsIndex) { oxtsIndex = _oxtsIndex; rotation_gps.release(); }
+
+	//cells of a ground image : column c is x_min + c * cell_x, row r is z_min + (rows - 1 - r) * cell_z
+	struct GroundGrid {
+		double x_min, z_min;
+		double cell_x, cell_z;
+		double max_depth;//cells farther from the camera are not filled, 0 : no limit
+	};
+	//gather mode on any ground image (CV_8UC1) : M world to image (InversePerspectiveMapping::getWorldToImage),
+	//sum integral image (CV_32S) of grayImage. mask may be empty
+	static void gatherGround(const Mat &grayImage, const Mat &sum, const double *M, const GroundGrid &grid,
+		Mat &groundImage, Mat &mask);
+
+	void processIPM(const Mat &image, const Mat &pose, Mat &IPMImage, Mat &IPMImageMask = Mat(), const Oxts_Data_Type *gpsData = NULL);
+	void processIPM(const Mat &image, const Matrix &pose, Mat &IPMImage, Mat &IPMImageMask = Mat(), const Oxts_Data_Type *gpsData = NULL);
 
 	InversePerspectiveMapping *ipm;
 	int height, width;
@@ -34,13 +60,17 @@ public:
 
 private:
 	bool showInfoVISO, showInfoGPS;
+	bool gather;
+	RoadMosaic *mosaic;
+	const OxtsIndex *oxtsIndex;
+	void gatherIPMImage(const Mat &grayImage, Mat &mask);
 	Mat rotation_gps;
 	double gpsData0[6];//x0,y0,h0,roll0,pitch0,yaw0
-	void initRotationGPS(Oxts_Data_Type *gpsData0);
+	void initRotationGPS(const Oxts_Data_Type *gpsData0);
 	double s, r; // for RADIANEARTH
 
 	void drawVehiclePosition();
-	void drawVehiclePosition(Oxts_Data_Type *gpsData);//gps position
+	void drawVehiclePosition(const Oxts_Data_Type *gpsData);//gps position
 
 	void resampleIPMImage(Mat &IPMImage, Mat &mask);
 
@@ -4,6 +4,7 @@
 #include <opencv2\opencv.hpp>
 #include <string>
 #include "../ConverterCoordinates/CC.h"
+#include "../VDisparity/GroundLineEstimator.h"
 using namespace cv;
 using namespace std;
 
@@ -61,6 +62,10 @@ public:
 	//remap from a point in image to camera coordinates system.
 	Point2d remapImg2World(double u, double v);
 
+	//world to (u,v) of the last updateFrameUsingStandardAssumption, 4 * 4 row major :
+	//z(0) * [u;v;1;1/z(0)] = M * [X; 0; Z; 1]
+	const double* getWorldToImage() const { return rCW2UV.ptr<double>(0); }
+
 
 	CC::CC_SimpleIPM simpleIPM;
 	double *remapX, *remapZ;
@@ -0,0 +1,277 @@
+#include "RoadMosaic.h"
+#include <iostream>
+#include <cmath>
+#include <climits>
+#include <cstring>
+using namespace std;
+
+static const char STORE_MAGIC[8] = "RMOSAI2";
+
+RoadMosaic::RoadMosaic(const string &_storeDir, const Param &_param)
+{
+	param = _param;
+	storeDir = _storeDir;
+	tileSizePx = (int)(param.tile_size * param.scale + 0.5);
+	center = TileKey(INT_MIN, INT_MIN);
+
+	//create the store if needed
+	string storeName = storeDir + "/tiles.bin";
+	{
+		ofstream create(storeName.c_str(), ios::binary | ios::app);
+	}
+	store.open(storeName.c_str(), ios::in | ios::out | ios::binary);
+	if (!store.is_open())
+		cout << "RoadMosaic : can not open " << storeName << endl;
+	storeEnd = 0;
+	nextSeq = 0;
+	scanStore();
+}
+
+RoadMosaic::~RoadMosaic()
+{
+	flush();
+}
+
+RoadMosaic::TileKey RoadMosaic::tileOf(double x, double z) const
+{
+	return TileKey((int)floor(x / param.tile_size), (int)floor(z / param.tile_size));
+}
+
+void RoadMosaic::addFrame(const Mat &grayImage, const double *M, double x, double z)
+{
+	TileKey key = tileOf(x, z);
+	if (key != center)
+		moveRing(key);
+
+	Mat sum;
+	integral(grayImage, sum, CV_32S);
+	Mat noMask;
+	for (map<TileKey, Mat>::iterator it = ring.begin(); it != ring.end(); it++)
+	{
+		InterfaceProcessIPMImage::GroundGrid grid;
+		grid.x_min = it->first.first * param.tile_size;
+		grid.z_min = it->first.second * param.tile_size;
+		grid.cell_x = grid.cell_z = param.tile_size / tileSizePx;
+		grid.max_depth = param.max_depth;
+
+		//tiles out of reach of the camera
+		double dx = max(0.0, max(grid.x_min - x, x - (grid.x_min + param.tile_size)));
+		double dz = max(0.0, max(grid.z_min - z, z - (grid.z_min + param.tile_size)));
+		if (dx * dx + dz * dz > param.max_depth * param.max_depth)
+			continue;
+
+		InterfaceProcessIPMImage::gatherGround(grayImage, sum, M, grid, it->second, noMask);
+		dirty.insert(it->first);
+	}
+}
+
+void RoadMosaic::moveRing(TileKey newCenter)
+{
+	//evict the tiles out of the new ring
+	for (map<TileKey, Mat>::iterator it = ring.begin(); it != ring.end();)
+	{
+		if (abs(it->first.first - newCenter.first) > param.ring || abs(it->first.second - newCenter.second) > param.ring)
+		{
+			if (dirty.erase(it->first))
+				writeTile(it->first, it->second);
+			it = ring.erase(it);
+		}
+		else
+			it++;
+	}
+
+	for (int tz = newCenter.second - param.ring; tz <= newCenter.second + param.ring; tz++)
+	{
+		for (int tx = newCenter.first - param.ring; tx <= newCenter.first + param.ring; tx++)
+		{
+			TileKey key(tx, tz);
+			if (ring.count(key))
+				continue;
+			Mat &tile = ring[key];
+			if (!readTile(key, tile))
+				tile = Mat::zeros(tileSizePx, tileSizePx, CV_8UC1);
+		}
+	}
+	center = newCenter;
+}
+
+void RoadMosaic::writeHeader(long long offset, const SlotHeader &header)
+{
+	store.clear();
+	store.seekp(offset);
+	store.write((const char*)&header, sizeof(header));
+}
+
+void RoadMosaic::writeTile(const TileKey &key, const Mat &tile)
+{
+	if (!store.is_open())
+		return;
+	map<TileKey, Slot>::iterator old = storeIndex.find(key);
+	//nothing seen on this tile
+	if (old == storeIndex.end() && countNonZero(tile) == 0)
+		return;
+
+	vector<uchar> png;
+	imencode(".png", tile, png);
+	SlotHeader header = { key.first, key.second, 0, (int)png.size(), nextSeq++ };
+
+	//the smallest free slot that holds the png, or a new slot at the end with some room to grow
+	Slot slot;
+	multimap<int, long long>::iterator f = freeSlots.lower_bound(header.bytes);
+	if (f != freeSlots.end())
+	{
+		slot.offset = f->second;
+		slot.capacity = f->first;
+		freeSlots.erase(f);
+	}
+	else
+	{
+		slot.offset = storeEnd;
+		slot.capacity = header.bytes + header.bytes / 4;
+		storeEnd += sizeof(SlotHeader) + slot.capacity;
+		//a free header first : the slot is complete on disk before it is used
+		SlotHeader empty = { key.first, key.second, slot.capacity, 0, 0 };
+		writeHeader(slot.offset, empty);
+	}
+	slot.bytes = header.bytes;
+	header.capacity = slot.capacity;
+
+	//png, then the header that makes the record live, then the old record is freed
+	store.clear();
+	store.seekp(slot.offset + sizeof(SlotHeader));
+	store.write((const char*)&png[0], png.size());
+	if (slot.capacity > header.bytes)
+	{
+		vector<char> pad(slot.capacity - header.bytes, 0);
+		store.write(&pad[0], pad.size());
+	}
+	store.flush();
+	writeHeader(slot.offset, header);
+	store.flush();
+	if (old != storeIndex.end())
+	{
+		SlotHeader freed = { key.first, key.second, old->second.capacity, 0, 0 };
+		writeHeader(old->second.offset, freed);
+		freeSlots.insert(make_pair(old->second.capacity, old->second.offset));
+	}
+	storeIndex[key] = slot;
+}
+
+bool RoadMosaic::readTile(const TileKey &key, Mat &tile)
+{
+	map<TileKey, Slot>::const_iterator it = storeIndex.find(key);
+	if (it == storeIndex.end() || !store.is_open())
+		return false;
+
+	store.flush();
+	store.clear();
+	store.seekg(it->second.offset + sizeof(SlotHeader));
+	vector<uchar> png(it->second.bytes);
+	store.read((char*)&png[0], png.size());
+	if (!store)
+	{
+		cout << "RoadMosaic : bad record of tile " << key.first << ", " << key.second << endl;
+		return false;
+	}
+	tile = imdecode(png, IMREAD_GRAYSCALE);
+	return tile.rows == tileSizePx && tile.cols == tileSizePx;
+}
+
+bool RoadMosaic::getTile(int tx, int tz, Mat &tile)
+{
+	TileKey key(tx, tz);
+	map<TileKey, Mat>::const_iterator it = ring.find(key);
+	if (it != ring.end())
+	{
+		it->second.copyTo(tile);
+		return true;
+	}
+	return readTile(key, tile);
+}
+
+void RoadMosaic::getRingImage(Mat &image) const
+{
+	int n = 2 * param.ring + 1;
+	image = Mat::zeros(n * tileSizePx, n * tileSizePx, CV_8UC1);
+	for (map<TileKey, Mat>::const_iterator it = ring.begin(); it != ring.end(); it++)
+	{
+		//largest z on the first row, as in a tile
+		int c = (it->first.first - center.first + param.ring) * tileSizePx;
+		int r = (center.second + param.ring - it->first.second) * tileSizePx;
+		Mat dst = image(Rect(c, r, tileSizePx, tileSizePx));
+		it->second.copyTo(dst);
+	}
+}
+
+void RoadMosaic::flush()
+{
+	for (map<TileKey, Mat>::const_iterator it = ring.begin(); it != ring.end(); it++)
+	{
+		if (dirty.erase(it->first))
+			writeTile(it->first, it->second);
+	}
+	store.flush();
+}
+
+void RoadMosaic::scanStore()
+{
+	if (!store.is_open())
+		return;
+	store.seekg(0, ios::end);
+	long long length = store.tellg();
+	store.seekg(0);
+	if (length == 0)
+	{
+		store.write(STORE_MAGIC, sizeof(STORE_MAGIC));
+		storeEnd = sizeof(STORE_MAGIC);
+		return;
+	}
+	char magic[sizeof(STORE_MAGIC)];
+	store.read(magic, sizeof(magic));
+	if (!store || memcmp(magic, STORE_MAGIC, sizeof(magic)) != 0)
+	{
+		cout << "RoadMosaic : " << storeDir << "/tiles.bin is not a tile store, no tile is stored" << endl;
+		store.close();
+		return;
+	}
+
+	//a slot cut by a crash ends the scan
+	storeEnd = sizeof(STORE_MAGIC);
+	SlotHeader header;
+	map<TileKey, long long> seqOf;
+	while (storeEnd + (long long)sizeof(header) <= length)
+	{
+		store.seekg(storeEnd);
+		store.read((char*)&header, sizeof(header));
+		if (!store || header.capacity < 0 || header.bytes < 0 || header.bytes > header.capacity
+			|| storeEnd + (long long)sizeof(header) + header.capacity > length)
+			break;
+
+		Slot slot = { storeEnd, header.capacity, header.bytes };
+		TileKey key(header.tx, header.tz);
+		map<TileKey, Slot>::iterator live = storeIndex.find(key);
+		if (header.bytes == 0)
+			freeSlots.insert(make_pair(slot.capacity, slot.offset));
+		else if (live == storeIndex.end() || seqOf[key] < header.seq)
+		{
+			//a crash between writing a tile and freeing its old slot leaves two records
+			if (live != storeIndex.end())
+				freeSlots.insert(make_pair(live->second.capacity, live->second.offset));
+			storeIndex[key] = slot;
+			seqOf[key] = header.seq;
+		}
+		else
+			freeSlots.insert(make_pair(slot.capacity, slot.offset));
+		nextSeq = max(nextSeq, header.seq + 1);
+		storeEnd += sizeof(header) + header.capacity;
+	}
+	store.clear();
+	//the bytes after the last complete slot become a free slot, shorter ones are overwritten by the next slot
+	if (storeEnd + (long long)sizeof(header) <= length)
+	{
+		SlotHeader rest = { 0, 0, (int)(length - storeEnd - sizeof(header)), 0, 0 };
+		writeHeader(storeEnd, rest);
+		freeSlots.insert(make_pair(rest.capacity, storeEnd));
+		storeEnd = length;
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef ROADMOSAIC_H
+#define ROADMOSAIC_H
+#include <opencv2\opencv.hpp>
+#include <map>
+#include <set>
+#include <fstream>
+#include <string>
+#include "IPMImage.h"
+using namespace cv;
+
+//RoadMosaic accumulates the bird's-eye view of the road in world coordinates (X, Z of the
+//ground of the first frame, m) over a whole drive with a fixed memory. The ground is cut in
+//square tiles of tile_size m; only the (2 * ring + 1)^2 tiles around the vehicle are in memory.
+//A tile leaving the ring is written to a tile store on disk (PNG) and read again if the vehicle
+//comes back.
+//File : <storeDir>/tiles.bin, a magic then slots (header tx, tz, capacity, bytes, seq, then capacity
+//bytes of png). bytes = 0 : free slot. The index of the tiles is rebuilt by scanning the slots on
+//open, the newest (largest seq) record of a tile wins. A tile is written to a free slot large enough
+//or to a new slot at the end, then its old slot is freed : the last good version of a tile survives
+//a crash and the store does not grow when the tiles are written again.
+class RoadMosaic {
+public:
+	struct Param {
+		Param() : tile_size(20), scale(IPM_IMAGE_SIZE_SCALE), ring(1), max_depth(IPM_Z_MAX) {}
+		double tile_size;//m
+		double scale;//pixels per m
+		int ring;//tiles kept on each side of the tile of the vehicle
+		double max_depth;//m, farther ground is not added
+	};
+
+	RoadMosaic(const std::string &_storeDir, const Param &_param = Param());
+	~RoadMosaic();//flush()
+
+	//add the view of a frame : gray image, M world to image of the frame
+	//(InversePerspectiveMapping::getWorldToImage), position (x, z) of the vehicle in the world
+	void addFrame(const Mat &grayImage, const double *M, double x, double z);
+
+	//tile (tx, tz) covers [tx, tx + 1) * tile_size in X and [tz, tz + 1) * tile_size in Z,
+	//first row at the largest Z. From memory or from the store, false if it was never seen
+	bool getTile(int tx, int tz, Mat &tile);
+
+	//bird's-eye image of the tiles in memory
+	void getRingImage(Mat &image) const;
+
+	//write the changed tiles in memory and the index to the store
+	void flush();
+
+	Param param;
+
+private:
+	typedef std::pair<int, int> TileKey;//(tx, tz)
+
+	int tileSizePx;
+	TileKey center;
+	std::map<TileKey, Mat> ring;
+	std::set<TileKey> dirty;//tiles of the ring changed since they were read or written
+
+	struct SlotHeader {
+		int tx, tz;
+		int capacity;//bytes of png the slot can hold
+		int bytes;//0 : free
+		long long seq;//order of the writes
+	};
+	struct Slot {
+		long long offset;//of the header in tiles.bin
+		int capacity;
+		int bytes;
+	};
+	std::map<TileKey, Slot> storeIndex;//live slot of each stored tile
+	std::multimap<int, long long> freeSlots;//capacity -> offset
+	long long storeEnd;//end of the last complete slot, new slots go there
+	long long nextSeq;
+	std::string storeDir;
+	std::fstream store;
+
+	TileKey tileOf(double x, double z) const;
+	void moveRing(TileKey newCenter);
+	void writeTile(const TileKey &key, const Mat &tile);
+	bool readTile(const TileKey &key, Mat &tile);
+	void scanStore();
+	void writeHeader(long long offset, const SlotHeader &header);
+};
+
+#endif
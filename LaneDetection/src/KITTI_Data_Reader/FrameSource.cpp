@@ -0,0 +1,141 @@
+#include "FrameSource.h"
+#include <iostream>
+using namespace std;
+
+void FrameSource::splitSideBySide(const Mat &frame, Mat &left, Mat &right)
+{
+	int half = frame.cols / 2;
+	left = frame.colRange(0, half);
+	right = frame.colRange(half, 2 * half);
+}
+
+KITTIFrameSource::KITTIFrameSource(const string &baseDir, const string &formatImage)
+	: reader(baseDir, formatImage)
+{
+}
+
+bool KITTIFrameSource::next(Mat &left, Mat &right)
+{
+	if (!reader.generateNextDataFileName())
+		return false;
+	reader.readImage(0, left);
+	reader.readImage(1, right);
+	return !left.empty();
+}
+
+VideoFrameSource::VideoFrameSource(const string &fileName, int _queueSize)
+{
+	queueSize = _queueSize > 0 ? _queueSize : 1;
+	finished = false;
+	quit = false;
+	if (!capture.open(fileName))
+	{
+		cout << "VideoFrameSource : can not open " << fileName << endl;
+		finished = true;
+	}
+	framesNum = finished ? 0 : (int)capture.get(CAP_PROP_FRAME_COUNT);
+	if (framesNum <= 0 && !finished)
+		framesNum = -1;
+	worker = thread(&VideoFrameSource::run, this);
+}
+
+VideoFrameSource::~VideoFrameSource()
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		quit = true;
+	}
+	cond.notify_all();
+	worker.join();
+}
+
+void VideoFrameSource::run()
+{
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(mtx);
+			cond.wait(lock, [this] { return (int)queue.size() < queueSize || quit; });
+			if (quit || finished)
+				return;
+		}
+
+		//decoding without the lock, the caller takes the frames already decoded meanwhile
+		Mat frame;
+		bool ok = capture.read(frame) && !frame.empty();
+
+		{
+			lock_guard<mutex> lock(mtx);
+			if (ok)
+				queue.push_back(frame);
+			else
+				finished = true;
+		}
+		cond.notify_all();
+		if (!ok)
+			return;
+	}
+}
+
+bool VideoFrameSource::next(Mat &left, Mat &right)
+{
+	{
+		unique_lock<mutex> lock(mtx);
+		cond.wait(lock, [this] { return !queue.empty() || finished; });
+		if (queue.empty())
+			return false;
+		current = queue.front();
+		queue.pop_front();
+	}
+	cond.notify_all();
+	splitSideBySide(current, left, right);
+	return true;
+}
+
+RawFrameSource::RawFrameSource(const string &fileName, const Param &_param)
+{
+	param = _param;
+	param.frames_per_read = max(1, param.frames_per_read);
+	blockFrames = blockPos = 0;
+	framesNum = 0;
+
+	in.open(fileName.c_str(), ios::binary | ios::ate);
+	if (!in.is_open() || param.width <= 0 || param.height <= 0)
+	{
+		cout << "RawFrameSource : can not read " << fileName << " with frames of " << param.width << "x" << param.height << endl;
+		return;
+	}
+	framesNum = (int)((int64)in.tellg() / ((int64)param.width * param.height));
+	in.seekg(0);
+	block.resize((size_t)param.width * param.height * param.frames_per_read);
+}
+
+bool RawFrameSource::next(Mat &left, Mat &right)
+{
+	if (!in.is_open())
+		return false;
+	if (blockPos >= blockFrames)
+	{
+		//one large sequential read for the next frames_per_read frames
+		size_t frameSize = (size_t)param.width * param.height;
+		in.read((char*)&block[0], block.size());
+		blockFrames = (int)(in.gcount() / frameSize);
+		blockPos = 0;
+		if (blockFrames == 0)
+			return false;
+	}
+
+	Mat raw(param.height, param.width, CV_8UC1, &block[(size_t)blockPos * param.width * param.height]);
+	blockPos++;
+
+	static const int bayerCodes[5] = { -1, COLOR_BayerBG2BGR, COLOR_BayerGB2BGR, COLOR_BayerRG2BGR, COLOR_BayerGR2BGR };
+	if (param.bayer > 0 && param.bayer < 5)
+	{
+		//both halves have the same pattern when the width of a camera is even
+		cvtColor(raw, current, bayerCodes[param.bayer]);
+	}
+	else
+		current = raw;
+	splitSideBySide(current, left, right);
+	return true;
+}
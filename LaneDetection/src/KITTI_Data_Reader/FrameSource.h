@@ -0,0 +1,104 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "KITTI_Data_Reader.h"
+#include <opencv2\opencv.hpp>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace cv;
+
+//Stereo frames of a recording, in order : the KITTI layout (or a .kpack), a video file or a raw
+//frame dump. Video and raw frames hold both cameras side by side (left half : camera 0).
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	//next pair, false at the end. The images may share memory with the source : read-only,
+	//valid until the next call
+	virtual bool next(Mat &left, Mat &right) = 0;
+	virtual int getFramesNum() const { return -1; }//-1 : unknown
+
+	//data of the last frame read, only for the KITTI layout
+	virtual bool readOxts(Oxts_Data_Type &oxts) const { return false; }
+	virtual bool readCalib(Calib_Data_Type &calib) const { return false; }
+	virtual bool readVelodyne(VelodyneScan &scan) const { return false; }
+	//OXTS records of all the frames, NULL without (a .kpack, video and raw frames)
+	virtual const OxtsIndex* getOxtsIndex() const { return NULL; }
+
+	//left and right halves of a side-by-side frame
+	static void splitSideBySide(const Mat &frame, Mat &left, Mat &right);
+};
+
+class KITTIFrameSource : public FrameSource
+{
+public:
+	KITTIFrameSource(const string &baseDir, const string &formatImage = ".png");
+
+	bool next(Mat &left, Mat &right);
+	int getFramesNum() const { return reader.getMaxIndex() + 1; }
+	bool readOxts(Oxts_Data_Type &oxts) const { return reader.readOxts(oxts); }
+	bool readCalib(Calib_Data_Type &calib) const { return reader.readCalib(calib); }
+	bool readVelodyne(VelodyneScan &scan) const { return reader.readVelodyne(scan); }
+	const OxtsIndex* getOxtsIndex() const { return reader.getOxtsIndex(); }
+
+	KITTI_Data_Reader reader;
+};
+
+//cv::VideoCapture decoding on its own thread, up to queue_size frames ahead of the caller
+class VideoFrameSource : public FrameSource
+{
+public:
+	VideoFrameSource(const string &fileName, int _queueSize = 4);
+	~VideoFrameSource();
+
+	bool next(Mat &left, Mat &right);
+	int getFramesNum() const { return framesNum; }
+
+private:
+	void run();
+
+	VideoCapture capture;
+	int framesNum;
+	int queueSize;
+	std::deque<Mat> queue;
+	Mat current;//frame of the last next(), left and right point into it
+	bool finished;//no more frame from the capture
+	bool quit;
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cond;
+};
+
+//fixed-size 8 bits frames one after the other (e.g. the dump of a Bayer camera), read by blocks
+//of frames_per_read frames with one sequential read
+class RawFrameSource : public FrameSource
+{
+public:
+	struct Param {
+		Param() : width(0), height(0), bayer(0), frames_per_read(16) {}
+		int width, height;//of a whole frame, both cameras
+		int bayer;//0 : gray, 1 : BG, 2 : GB, 3 : RG, 4 : GR (pattern of the top-left pixels)
+		int frames_per_read;
+	};
+
+	RawFrameSource(const string &fileName, const Param &_param);
+
+	bool next(Mat &left, Mat &right);
+	int getFramesNum() const { return framesNum; }
+
+	Param param;
+
+private:
+	std::ifstream in;
+	int framesNum;
+	std::vector<uchar> block;
+	int blockFrames;//frames in block
+	int blockPos;//next frame of block
+	Mat current;
+};
+
+#endif
@@ -1,4 +1,7 @@
 ﻿#include "KITTI_Data_Reader.h"
+#include "SequencePack.h"
+#include "OxtsIndex.h"
+#include "VelodyneScan.h"
 #include <fstream>
 
 /*
@@ -43,22 +46,34 @@ string generateFileNameFormat(int _index)
 	return s;
 }
 
+static bool imageExists(const string &path, int index, const string &formatImage)
+{
+	ifstream fileStream(path + "\\" + generateFileNameFormat(index) + formatImage);
+	return fileStream.is_open();
+}
+
+//the images are numbered from 0 without gap : doubling then bisection on the first missing index
 int getImagesNum(string path, string formatImage)
 {
 	const int MAX_NUM = 10000;
-	int num = 0;
-	for (int i = 0; i < MAX_NUM; i++)
+	if (!imageExists(path, 0, formatImage))
+		return -1;
+	int lo = 0, hi = 1;//lo exists, hi is not known to exist
+	while (hi < MAX_NUM && imageExists(path, hi, formatImage))
 	{
-		string s = generateFileNameFormat(i);
-		s = path + "\\" + s + formatImage;
-		ifstream fileStream(s);
-		if (!fileStream.is_open())
-		{
-			num = i;
-			break;
-		}
+		lo = hi;
+		hi *= 2;
+	}
+	hi = min(hi, MAX_NUM);
+	while (hi - lo > 1)
+	{
+		int mid = (lo + hi) / 2;
+		if (imageExists(path, mid, formatImage))
+			lo = mid;
+		else
+			hi = mid;
 	}
-	return num - 1;
+	return lo;
 }
 
 
@@ -66,30 +81,35 @@ int getImagesNum(string path, string formatImage)
 KITTI_Data_Reader::KITTI_Data_Reader(){
 	baseDir = "";
 	formatImage = ".png";
+	curIndex = -1;
 }
 
 KITTI_Data_Reader::KITTI_Data_Reader(string _baseDir, string _formatImage){
 	baseDir = _baseDir;
 	dataIndex = 0;
+	curIndex = -1;
+	const string packExtension = ".kpack";
+	if (baseDir.size() > packExtension.size() &&
+		baseDir.compare(baseDir.size() - packExtension.size(), packExtension.size(), packExtension) == 0)
+	{
+		pack = std::make_shared<SequencePack>();
+		if (!pack->open(baseDir))
+			pack.reset();
+		maxIndex = pack ? pack->getFramesNum() - 1 : -1;
+		formatImage = _formatImage;
+		return;
+	}
 	generateDataDirs();
-	maxIndex = getMaxIndexFromTimeStamps();
+	//the frames are counted by the timestamps of the index, built once for the drive
+	oxtsIndex = std::make_shared<OxtsIndex>();
+	if (!oxtsIndex->open(baseDir))
+		oxtsIndex.reset();
+	maxIndex = oxtsIndex ? oxtsIndex->size() - 1 : -1;
 	formatImage = _formatImage;
 	if (maxIndex < 0)
 		maxIndex = getImagesNum(imageDirs[0] + "data", formatImage);
 }
 
-int KITTI_Data_Reader::getMaxIndexFromTimeStamps(){
-	ifstream in(imageDirs[0] + "timestamps.txt");
-	if (!in.is_open()) return -1;
-
-	int numLines = 0;
-	string lineNoUse;
-	while (getline(in, lineNoUse))
-		numLines++;
-
-	return numLines - 1;
-}
-
 void KITTI_Data_Reader::generateDataDirs(){
 	imageDirs[0] = baseDir + "\\image_00\\";
 	imageDirs[1] = baseDir + "\\image_01\\";
@@ -97,7 +117,7 @@ void KITTI_Data_Reader::generateDataDirs(){
 	imageDirs[3] = baseDir + "\\image_03\\";
 
 	oxtsDir = baseDir + "\\oxts\\";
-	velodyneDir = baseDir + "\\velodyneDir\\";
+	velodyneDir = baseDir + "\\velodyne_points\\";
 }
 
 bool KITTI_Data_Reader::generateNextDataFileName(int _index){
@@ -108,6 +128,9 @@ bool KITTI_Data_Reader::generateNextDataFileName(int _index){
 	}
 
 	if (_index > maxIndex) return false;
+	curIndex = _index;
+	if (pack)
+		return true;
 
 	string fileName = generateFileNameFormat(_index);
 	for (int i = 0; i < 4; i++)
@@ -120,6 +143,46 @@ bool KITTI_Data_Reader::generateNextDataFileName(int _index){
 	return true;
 }
 
+bool KITTI_Data_Reader::readImage(int camera, cv::Mat &image) const
+{
+	if (pack)
+		return pack->getImage(curIndex, camera, image);
+	if (camera < 0 || camera > 3)
+		return false;
+	image = cv::imread(curImageFileName[camera], -1);
+	return !image.empty();
+}
+
+bool KITTI_Data_Reader::readOxts(Oxts_Data_Type &oxts) const
+{
+	if (pack)
+		return pack->getOxts(curIndex, oxts);
+	if (oxtsIndex)
+	{
+		const Oxts_Data_Type *record = oxtsIndex->getOxts(curIndex);
+		if (record != NULL)
+			oxts = *record;
+		return record != NULL;
+	}
+	ifstream in(curOxtsFileName);
+	if (!in.is_open())
+		return false;
+	in >> oxts;
+	return !in.fail();
+}
+
+bool KITTI_Data_Reader::readCalib(Calib_Data_Type &calib) const
+{
+	return pack && pack->getCalib(calib);
+}
+
+bool KITTI_Data_Reader::readVelodyne(VelodyneScan &scan) const
+{
+	if (pack || curIndex < 0)
+		return false;
+	return scan.open(curVelodyneFileName);
+}
+
 ifstream& operator >> (ifstream &in, Oxts_Data_Type &oxts_data)
 {
 	in >> oxts_data.lat >> oxts_data.lon >> oxts_data.alt;
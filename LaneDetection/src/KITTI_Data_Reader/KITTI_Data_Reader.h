@@ -4,6 +4,8 @@
 
 #include <string>
 #include <fstream>
+#include <memory>
+#include <opencv2\opencv.hpp>
 using namespace std;
 
 class Oxts_Data_Type{
@@ -107,10 +109,16 @@ public:
 	friend ofstream& operator << (ofstream &of, const Calib_Data_Type &calib_data);
 };
 
+class SequencePack;
+class OxtsIndex;
+class VelodyneScan;
+
 //With respecting the format of KITTI data set, forder address as input baseDir, 
 //KITTI_Data_Reader will count the number of frames and generate file names of images, 
 //oxts files and velodyne files. And it will update automaticly for next frame after 
 //reading this frame.
+//baseDir may also be a drive packed by SequencePack::pack (.kpack), then the images, oxts
+//and calibration of read* come from the memory-mapped pack.
 class KITTI_Data_Reader
 {
 public:
@@ -121,11 +129,21 @@ public:
 
 	bool generateNextDataFileName(int _dataIndex = -1);
 
+	//data of the current frame (the last generateNextDataFileName), from the pack or the files.
+	//images of a raw pack are read-only, without copy
+	bool readImage(int camera, cv::Mat &image) const;
+	bool readOxts(Oxts_Data_Type &oxts) const;
+	bool readCalib(Calib_Data_Type &calib) const;//only from a pack
+	bool readVelodyne(VelodyneScan &scan) const;//only from the directory layout
+	bool isPacked() const { return pack != NULL; }
+	//OXTS records and timestamps of the drive, NULL for a pack or without image_00\timestamps.txt
+	const OxtsIndex* getOxtsIndex() const { return oxtsIndex.get(); }
+
 	string curImageFileName[4];//left gray, right gray, left color, right color
 	string curOxtsFileName;
 	string curVelodyneFileName;
 	void setMaxIndex(int n) { maxIndex = n; }
-	int getMaxIndex() { return maxIndex; }
+	int getMaxIndex() const { return maxIndex; }
 	void jumpToIndex(int _dataIndex) 
 	{ 
 		dataIndex = _dataIndex; 
@@ -133,13 +151,15 @@ public:
 	}
 private:
 	void generateDataDirs();
-	int getMaxIndexFromTimeStamps();
 	string imageDirs[4];//left gray, right gray, left color, right color
 	string oxtsDir;//gps data file dir
 	string velodyneDir;//laser data dir
 	int dataIndex;
 	int maxIndex;
 	string formatImage;
+	int curIndex;
+	std::shared_ptr<SequencePack> pack;
+	std::shared_ptr<OxtsIndex> oxtsIndex;
 };
 
 
@@ -0,0 +1,84 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	base = NULL;
+	length = 0;
+	fileHandle = mapHandle = NULL;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string &fileName, bool sequential)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	fileHandle = file;
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	length = size.QuadPart;
+	if (length == 0)
+		return true;//nothing to map, data() is NULL
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	mapHandle = mapping;
+	base = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	fileHandle = (void*)(intptr_t)(fd + 1);
+	struct stat st;
+	fstat(fd, &st);
+	length = st.st_size;
+	if (length == 0)
+		return true;
+	void *view = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (view != MAP_FAILED)
+	{
+		madvise(view, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+		base = (const unsigned char*)view;
+	}
+#endif
+	if (base == NULL)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (base)
+		UnmapViewOfFile(base);
+	if (mapHandle)
+		CloseHandle((HANDLE)mapHandle);
+	if (fileHandle)
+		CloseHandle((HANDLE)fileHandle);
+#else
+	if (base)
+		munmap((void*)base, length);
+	if (fileHandle)
+		::close((int)(intptr_t)fileHandle - 1);
+#endif
+	base = NULL;
+	length = 0;
+	fileHandle = mapHandle = NULL;
+}
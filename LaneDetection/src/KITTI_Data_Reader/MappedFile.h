@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <stdint.h>
+
+//read-only memory mapping of a whole file (MapViewOfFile on windows, mmap otherwise)
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	//sequential : the file is read from the start to the end (read-ahead hint)
+	bool open(const std::string &fileName, bool sequential = true);
+	void close();
+	bool isOpen() const { return base != NULL; }
+
+	const unsigned char* data() const { return base; }
+	int64_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const unsigned char *base;
+	int64_t length;
+	void *fileHandle, *mapHandle;//windows handles, or the file descriptor + 1 in fileHandle
+};
+
+#endif
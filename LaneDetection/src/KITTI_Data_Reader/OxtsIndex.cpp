@@ -0,0 +1,172 @@
+#include "OxtsIndex.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+static const char INDEX_MAGIC[8] = "OXTSIX1";
+
+OxtsIndex::OxtsIndex()
+{
+	t0 = period = 0;
+}
+
+//days since 1970-01-01 of a date of the gregorian calendar
+static int64_t daysFromCivil(int y, int m, int d)
+{
+	y -= m <= 2;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+int64_t OxtsIndex::parseTimestamp(const string &line)
+{
+	int year, month, day, hour, minute, second;
+	char fraction[16] = { 0 };
+	if (sscanf(line.c_str(), "%d-%d-%d %d:%d:%d.%15[0-9]", &year, &month, &day, &hour, &minute, &second, fraction) < 6)
+		return -1;
+	//the fraction has up to 9 digits (ns), read as an integer to keep all of them
+	int64_t ns = 0;
+	for (int i = 0; i < 9; i++)
+		ns = ns * 10 + (fraction[i] >= '0' && fraction[i] <= '9' ? fraction[i] - '0' : 0);
+	int64_t s = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	return s * 1000000000LL + ns;
+}
+
+bool OxtsIndex::open(const string &baseDir)
+{
+	string fileName = baseDir + "\\oxts_index.bin";
+	if (load(fileName))
+	{
+		if (matches(baseDir))
+			return true;
+		cout << "OxtsIndex : " << fileName << " does not match the timestamps of the drive, rebuilt" << endl;
+	}
+	if (!build(baseDir))
+		return false;
+	if (!save(fileName))
+		cout << "OxtsIndex : can not save " << fileName << ", the index is rebuilt next time" << endl;
+	return true;
+}
+
+bool OxtsIndex::build(const string &baseDir)
+{
+	records.clear();
+	ifstream timeIn((baseDir + "\\image_00\\timestamps.txt").c_str());
+	if (!timeIn.is_open())
+		return false;
+
+	string line;
+	while (getline(timeIn, line))
+	{
+		if (line.empty())
+			continue;
+		Record r;
+		memset(&r, 0, sizeof(r));
+		r.time_ns = parseTimestamp(line);
+
+		char name[16];
+		sprintf(name, "%010d", (int)records.size());
+		ifstream oxtsIn((baseDir + "\\oxts\\data\\" + name + ".txt").c_str());
+		if (oxtsIn.is_open())
+		{
+			oxtsIn >> r.oxts;
+			r.has_oxts = !oxtsIn.fail();
+		}
+		records.push_back(r);
+	}
+	computePeriod();
+	return !records.empty();
+}
+
+bool OxtsIndex::matches(const string &baseDir) const
+{
+	ifstream timeIn((baseDir + "\\image_00\\timestamps.txt").c_str());
+	if (!timeIn.is_open())
+		return true;
+	//only the timestamps are read, not the oxts files
+	string line;
+	int n = 0;
+	while (getline(timeIn, line))
+	{
+		if (line.empty())
+			continue;
+		if (n >= size() || records[n].time_ns != parseTimestamp(line))
+			return false;
+		n++;
+	}
+	return n == size();
+}
+
+bool OxtsIndex::load(const string &fileName)
+{
+	ifstream in(fileName.c_str(), ios::binary | ios::ate);
+	if (!in.is_open())
+		return false;
+	int64_t length = (int64_t)in.tellg();
+	int64_t n = (length - (int64_t)sizeof(INDEX_MAGIC)) / (int64_t)sizeof(Record);
+	if (n <= 0 || length != (int64_t)sizeof(INDEX_MAGIC) + n * (int64_t)sizeof(Record))
+		return false;
+
+	//one read of the whole file : magic then the records
+	vector<char> buffer((size_t)length);
+	in.seekg(0);
+	in.read(&buffer[0], length);
+	if (!in || memcmp(&buffer[0], INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+		return false;
+	records.resize((size_t)n);
+	memcpy(&records[0], &buffer[sizeof(INDEX_MAGIC)], (size_t)n * sizeof(Record));
+	computePeriod();
+	return true;
+}
+
+bool OxtsIndex::save(const string &fileName) const
+{
+	ofstream out(fileName.c_str(), ios::binary | ios::trunc);
+	if (!out.is_open())
+		return false;
+	out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	if (!records.empty())
+		out.write((const char*)&records[0], records.size() * sizeof(Record));
+	return out.good();
+}
+
+void OxtsIndex::computePeriod()
+{
+	int n = size();
+	t0 = n > 0 ? records[0].time_ns : 0;
+	period = n > 1 ? (records[n - 1].time_ns - t0) / (n - 1) : 0;
+}
+
+const Oxts_Data_Type* OxtsIndex::getOxts(int index) const
+{
+	if (index < 0 || index >= size() || !records[index].has_oxts)
+		return NULL;
+	return &records[index].oxts;
+}
+
+int64_t OxtsIndex::getTime(int index) const
+{
+	if (index < 0 || index >= size())
+		return -1;
+	return records[index].time_ns;
+}
+
+int OxtsIndex::findFrame(int64_t time_ns) const
+{
+	int n = size();
+	if (n == 0)
+		return -1;
+	int k = period > 0 ? (int)((time_ns - t0 + period / 2) / period) : 0;
+	k = max(0, min(n - 1, k));
+	//the frame rate is not exactly regular : a few steps to the closest timestamp
+	while (k > 0 && llabs(records[k - 1].time_ns - time_ns) <= llabs(records[k].time_ns - time_ns))
+		k--;
+	while (k < n - 1 && llabs(records[k + 1].time_ns - time_ns) < llabs(records[k].time_ns - time_ns))
+		k++;
+	return k;
+}
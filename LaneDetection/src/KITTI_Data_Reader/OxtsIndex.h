@@ -0,0 +1,48 @@
+#ifndef OXTS_INDEX_H
+#define OXTS_INDEX_H
+
+#include "KITTI_Data_Reader.h"
+#include <vector>
+#include <stdint.h>
+
+//OXTS records and timestamps of all the frames of a drive in one table of fixed-size records,
+//built once from the text files (image_00/timestamps.txt, oxts/data/*.txt) and saved in binary
+//(baseDir\oxts_index.bin), then loaded with a single read.
+class OxtsIndex
+{
+public:
+	OxtsIndex();
+
+	//the saved index of baseDir if it is there and matches timestamps.txt, built from the text
+	//files (and saved) otherwise
+	bool open(const string &baseDir);
+	bool build(const string &baseDir);
+	bool load(const string &fileName);
+	bool save(const string &fileName) const;
+	//same frames and timestamps as image_00/timestamps.txt of baseDir, true without the file
+	bool matches(const string &baseDir) const;
+
+	int size() const { return (int)records.size(); }
+	//NULL if the frame has no OXTS record
+	const Oxts_Data_Type* getOxts(int index) const;
+	int64_t getTime(int index) const;//nanoseconds since 1970-01-01, -1 if unknown
+	//frame of the closest timestamp, -1 if none. O(1) for a regular frame rate
+	int findFrame(int64_t time_ns) const;
+
+	//"2011-09-26 13:02:25.964389445" -> nanoseconds since 1970-01-01, -1 if not a timestamp
+	static int64_t parseTimestamp(const string &line);
+
+private:
+	struct Record {
+		int64_t time_ns;
+		int32_t has_oxts;
+		int32_t reserved;
+		Oxts_Data_Type oxts;
+	};
+	std::vector<Record> records;
+	int64_t t0, period;//time of frame 0 and mean frame period, first guess of findFrame
+
+	void computePeriod();
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "SequencePack.h"
+#include "OxtsIndex.h"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+static const char PACK_MAGIC[8] = "KPACK02";
+static const int PACK_ALIGN = 16;
+
+static void padTo(ofstream &out, int64_t align)
+{
+	static const char zeros[PACK_ALIGN] = { 0 };
+	int64_t pos = (int64_t)out.tellp();
+	if (pos % align)
+		out.write(zeros, align - pos % align);
+}
+
+//[offset, offset + size) inside a file of length bytes, without overflow
+static bool inFile(int64_t offset, int64_t size, int64_t length)
+{
+	return offset >= 0 && size >= 0 && offset <= length && size <= length - offset;
+}
+
+SequencePack::SequencePack()
+{
+	base = NULL;
+	length = 0;
+	header = NULL;
+	frames = NULL;
+}
+
+SequencePack::~SequencePack()
+{
+	close();
+}
+
+bool SequencePack::pack(const string &baseDir, const string &calibFileName, const string &packFileName,
+	const string &formatImage, int compression)
+{
+	KITTI_Data_Reader reader(baseDir, formatImage);
+	int n_frames = reader.getMaxIndex() + 1;
+	if (n_frames <= 0)
+	{
+		cout << "SequencePack : no frame in " << baseDir << endl;
+		return false;
+	}
+
+	ofstream out(packFileName.c_str(), ios::binary | ios::trunc);
+	if (!out.is_open())
+	{
+		cout << "SequencePack : can not create " << packFileName << endl;
+		return false;
+	}
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, PACK_MAGIC, sizeof(h.magic));
+	h.n_frames = n_frames;
+	out.write((const char*)&h, sizeof(h));
+
+	vector<Frame> frameTable(n_frames);
+	vector<Oxts_Data_Type> oxtsTable(n_frames);
+	memset(&frameTable[0], 0, n_frames * sizeof(Frame));
+	memset(&oxtsTable[0], 0, n_frames * sizeof(Oxts_Data_Type));
+
+	//timestamps and oxts records of the drive, indexed by the reader
+	OxtsIndex emptyIndex;
+	const OxtsIndex &oxtsIndex = reader.getOxtsIndex() ? *reader.getOxtsIndex() : emptyIndex;
+	vector<int> params;
+	if (compression > 0)
+	{
+		params.push_back(IMWRITE_PNG_COMPRESSION);
+		params.push_back(min(compression, 9));
+	}
+	vector<uchar> buffer;
+
+	for (int i = 0; i < n_frames; i++)
+	{
+		reader.generateNextDataFileName(i);
+		Frame &f = frameTable[i];
+
+		f.time_ns = oxtsIndex.getTime(i);
+		const Oxts_Data_Type *oxts = oxtsIndex.getOxts(i);
+		if (oxts != NULL)
+		{
+			oxtsTable[i] = *oxts;
+			f.has_oxts = 1;
+		}
+
+		for (int c = 0; c < N_CAMERAS; c++)
+		{
+			Mat image = imread(reader.curImageFileName[c], -1);
+			if (image.empty())
+				continue;//drives without color (or gray) images
+
+			padTo(out, PACK_ALIGN);
+			Image &im = f.image[c];
+			im.offset = (int64_t)out.tellp();
+			im.rows = image.rows;
+			im.cols = image.cols;
+			im.type = image.type();
+			if (compression > 0)
+			{
+				imencode(".png", image, buffer, params);
+				im.codec = CODEC_PNG;
+				im.size = buffer.size();
+				out.write((const char*)&buffer[0], buffer.size());
+			}
+			else
+			{
+				//rows without padding, so that the image is one continuous block
+				im.codec = CODEC_RAW;
+				im.size = (int64_t)image.total() * image.elemSize();
+				if (!image.isContinuous())
+					image = image.clone();
+				out.write((const char*)image.data, im.size);
+			}
+		}
+		if (i % 100 == 0)
+			cout << "SequencePack : frame " << i << " / " << n_frames << endl;
+	}
+
+	padTo(out, PACK_ALIGN);
+	h.frames_offset = (int64_t)out.tellp();
+	out.write((const char*)&frameTable[0], n_frames * sizeof(Frame));
+	h.oxts_offset = (int64_t)out.tellp();
+	out.write((const char*)&oxtsTable[0], n_frames * sizeof(Oxts_Data_Type));
+
+	if (!calibFileName.empty())
+	{
+		ifstream calibIn(calibFileName.c_str());
+		if (calibIn.is_open())
+		{
+			Calib_Data_Type calib;
+			calibIn >> calib;
+			h.has_calib = 1;
+			h.calib_offset = (int64_t)out.tellp();
+			out.write((const char*)&calib, sizeof(calib));
+		}
+		else
+			cout << "SequencePack : can not open " << calibFileName << ", packed without calibration" << endl;
+	}
+
+	out.seekp(0);
+	out.write((const char*)&h, sizeof(h));
+	if (!out.good())
+	{
+		cout << "SequencePack : error writing " << packFileName << endl;
+		return false;
+	}
+	cout << "SequencePack : " << n_frames << " frames packed in " << packFileName << endl;
+	return true;
+}
+
+bool SequencePack::open(const string &packFileName)
+{
+	close();
+	if (!file.open(packFileName))
+	{
+		cout << "SequencePack : can not open " << packFileName << endl;
+		return false;
+	}
+	base = file.data();
+	length = file.size();
+	if (base == NULL || length < (int64_t)sizeof(Header) || memcmp(base, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0)
+	{
+		cout << "SequencePack : " << packFileName << " is not a sequence pack" << endl;
+		close();
+		return false;
+	}
+
+	header = (const Header*)base;
+	//every offset of the pack is checked once here, the getters read without checks
+	bool valid = header->n_frames >= 0
+		&& inFile(header->frames_offset, header->n_frames * (int64_t)sizeof(Frame), length)
+		&& inFile(header->oxts_offset, header->n_frames * (int64_t)sizeof(Oxts_Data_Type), length)
+		&& (!header->has_calib || inFile(header->calib_offset, sizeof(Calib_Data_Type), length));
+	if (valid)
+	{
+		frames = (const Frame*)(base + header->frames_offset);
+		for (int i = 0; valid && i < header->n_frames; i++)
+			for (int c = 0; valid && c < N_CAMERAS; c++)
+			{
+				const Image &im = frames[i].image[c];
+				valid = inFile(im.offset, im.size, length);
+				//a raw image is mapped as a Mat of rows x cols
+				if (valid && im.size > 0 && im.codec == CODEC_RAW)
+					valid = im.rows >= 0 && im.cols >= 0
+						&& (int64_t)im.rows * im.cols * CV_ELEM_SIZE(im.type) <= im.size;
+			}
+	}
+	if (!valid)
+	{
+		cout << "SequencePack : " << packFileName << " is truncated or corrupted" << endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void SequencePack::close()
+{
+	file.close();
+	base = NULL;
+	length = 0;
+	header = NULL;
+	frames = NULL;
+}
+
+bool SequencePack::getImage(int index, int camera, Mat &image) const
+{
+	if (!isOpen() || index < 0 || index >= header->n_frames || camera < 0 || camera >= N_CAMERAS)
+		return false;
+	const Image &im = frames[index].image[camera];
+	if (im.size == 0)
+		return false;
+
+	if (im.codec == CODEC_RAW)
+		image = Mat(im.rows, im.cols, im.type, (void*)(base + im.offset));
+	else
+		image = imdecode(Mat(1, (int)im.size, CV_8UC1, (void*)(base + im.offset)), -1);
+	return !image.empty();
+}
+
+int64_t SequencePack::getTime(int index) const
+{
+	if (!isOpen() || index < 0 || index >= header->n_frames)
+		return -1;
+	return frames[index].time_ns;
+}
+
+bool SequencePack::getOxts(int index, Oxts_Data_Type &oxts) const
+{
+	if (!isOpen() || index < 0 || index >= header->n_frames || !frames[index].has_oxts)
+		return false;
+	memcpy(&oxts, base + header->oxts_offset + index * sizeof(Oxts_Data_Type), sizeof(Oxts_Data_Type));
+	return true;
+}
+
+bool SequencePack::getCalib(Calib_Data_Type &calib) const
+{
+	if (!isOpen() || !header->has_calib)
+		return false;
+	memcpy(&calib, base + header->calib_offset, sizeof(Calib_Data_Type));
+	return true;
+}
@@ -0,0 +1,67 @@
+#ifndef SEQUENCE_PACK_H
+#define SEQUENCE_PACK_H
+
+#include "KITTI_Data_Reader.h"
+#include "MappedFile.h"
+#include <opencv2\opencv.hpp>
+#include <stdint.h>
+using namespace cv;
+
+//A KITTI drive packed in one file (.kpack) : the images of the 4 cameras, the timestamps,
+//the OXTS records and the calibration, read through a memory mapping of the file.
+//
+//layout : Header | images (16 bytes aligned) | Frame[n_frames] | Oxts_Data_Type[n_frames] | Calib_Data_Type
+//the images are raw pixels (served without copy) or PNG (decoded on read).
+class SequencePack
+{
+public:
+	enum Codec { CODEC_RAW = 0, CODEC_PNG = 1 };
+	static const int N_CAMERAS = 4;//left gray, right gray, left color, right color
+
+	SequencePack();
+	~SequencePack();
+
+	//pack the drive baseDir (calibFileName may be empty). compression : 0 raw, 1..9 PNG level
+	static bool pack(const string &baseDir, const string &calibFileName, const string &packFileName,
+		const string &formatImage = ".png", int compression = 0);
+
+	bool open(const string &packFileName);
+	void close();
+	bool isOpen() const { return base != NULL; }
+
+	int getFramesNum() const { return isOpen() ? header->n_frames : 0; }
+	//raw images : header on the mapped file, read-only and valid until close(). false if absent
+	bool getImage(int index, int camera, Mat &image) const;
+	int64_t getTime(int index) const;//nanoseconds since 1970-01-01, -1 if unknown
+	bool getOxts(int index, Oxts_Data_Type &oxts) const;
+	bool getCalib(Calib_Data_Type &calib) const;
+
+private:
+	struct Header {
+		char magic[8];//"KPACK02"
+		int32_t n_frames;
+		int32_t has_calib;
+		int64_t frames_offset;
+		int64_t oxts_offset;
+		int64_t calib_offset;
+	};
+	struct Image {
+		int64_t offset;
+		int64_t size;//0 : no image
+		int32_t rows, cols, type, codec;
+	};
+	struct Frame {
+		int64_t time_ns;
+		int32_t has_oxts;
+		int32_t reserved;
+		Image image[N_CAMERAS];
+	};
+
+	MappedFile file;
+	const uchar *base;
+	int64_t length;
+	const Header *header;
+	const Frame *frames;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "VelodyneScan.h"
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+bool VelodyneScan::open(const string &fileName)
+{
+	//the points are read once, in order
+	if (!file.open(fileName, true))
+		return false;
+	return file.size() % (4 * sizeof(float)) == 0;
+}
+
+bool VelodyneScan::readCalibVeloToCam(const string &fileName, double R[9], double T[3])
+{
+	ifstream in(fileName.c_str());
+	if (!in.is_open())
+	{
+		cout << "can not open " << fileName << endl;
+		return false;
+	}
+	bool hasR = false, hasT = false;
+	string prefix;
+	while (in >> prefix)
+	{
+		if (prefix == "R:")
+		{
+			for (int i = 0; i < 9; i++)
+				in >> R[i];
+			hasR = !in.fail();
+		}
+		else if (prefix == "T:")
+		{
+			for (int i = 0; i < 3; i++)
+				in >> T[i];
+			hasT = !in.fail();
+		}
+	}
+	return hasR && hasT;
+}
@@ -0,0 +1,25 @@
+#ifndef VELODYNE_SCAN_H
+#define VELODYNE_SCAN_H
+
+#include "MappedFile.h"
+#include <string>
+
+//one velodyne scan of KITTI (velodyne_points\data\%010d.bin) : x, y, z, reflectance in float32
+//for each point, x forward, y left, z up (meter). The file is mapped, the points are not copied.
+class VelodyneScan
+{
+public:
+	bool open(const std::string &fileName);
+	void close() { file.close(); }
+
+	int size() const { return (int)(file.size() / (4 * sizeof(float))); }
+	const float* points() const { return (const float*)file.data(); }//4 floats per point
+
+	//calib_velo_to_cam.txt : p_cam0 = R * p_velo + T (camera 0 before rectification)
+	static bool readCalibVeloToCam(const std::string &fileName, double R[9], double T[3]);
+
+private:
+	MappedFile file;
+};
+
+#endif
@@ -62,4 +62,239 @@ public:
 	Mat temp4;
 	float temp5;
 
-};
\ No newline at end of file
+};
+
+//Extended Kalman filter of fixed dimensions : DP state values, MP measurement values.
+//All matrices are arrays inside the object, nothing is allocated by predict() or correct(),
+//so that hundreds of measurement updates per frame stay cheap. Same conventions as
+//EKalmanFilter : the caller linearizes (measurementMatrix) and gives the residual.
+template<int DP, int MP = 1>
+class FixedEKalmanFilter{
+public:
+	FixedEKalmanFilter() { init(); }
+
+	//A = I, Q = I, R = I, everything else 0
+	void init()
+	{
+		for (int i = 0; i < DP; i++)
+		{
+			statePre[i] = statePost[i] = 0;
+			for (int j = 0; j < DP; j++)
+			{
+				transitionMatrix[i][j] = processNoiseCov[i][j] = (i == j) ? 1.f : 0.f;
+				errorCovPre[i][j] = errorCovPost[i][j] = 0;
+			}
+		}
+		for (int i = 0; i < MP; i++)
+		{
+			for (int j = 0; j < DP; j++)
+				measurementMatrix[i][j] = 0;
+			for (int j = 0; j < MP; j++)
+				measurementNoiseCov[i][j] = (i == j) ? 1.f : 0.f;
+		}
+	}
+
+	void setIdentity(float M[DP][DP], float s)
+	{
+		for (int i = 0; i < DP; i++)
+			for (int j = 0; j < DP; j++)
+				M[i][j] = (i == j) ? s : 0.f;
+	}
+
+	//x'(k) = A*x(k), P'(k) = A*P(k)*At + Q
+	const float* predict()
+	{
+		float temp1[DP][DP];
+		for (int i = 0; i < DP; i++)
+		{
+			statePre[i] = 0;
+			for (int k = 0; k < DP; k++)
+				statePre[i] += transitionMatrix[i][k] * statePost[k];
+			for (int j = 0; j < DP; j++)
+			{
+				temp1[i][j] = 0;
+				for (int k = 0; k < DP; k++)
+					temp1[i][j] += transitionMatrix[i][k] * errorCovPost[k][j];
+			}
+		}
+		for (int i = 0; i < DP; i++)
+			for (int j = 0; j < DP; j++)
+			{
+				float p = processNoiseCov[i][j];
+				for (int k = 0; k < DP; k++)
+					p += temp1[i][k] * transitionMatrix[j][k];
+				errorCovPre[i][j] = p;
+			}
+
+		// handle the case when there will be measurement before the next predict.
+		for (int i = 0; i < DP; i++)
+		{
+			statePost[i] = statePre[i];
+			for (int j = 0; j < DP; j++)
+				errorCovPost[i][j] = errorCovPre[i][j];
+		}
+		return statePre;
+	}
+
+	//x(k) = x'(k) + K(k)*y, P(k) = P'(k) - K(k)*H*P'(k), K(k) = P'(k)*Ht*inv(H*P'(k)*Ht + R).
+	//y = z(k) - h(x'(k)) is the residual of the measurement.
+	const float* correct(const float y[MP])
+	{
+		// temp2 = H*P'(k)
+		float temp2[MP][DP];
+		for (int i = 0; i < MP; i++)
+			for (int j = 0; j < DP; j++)
+			{
+				temp2[i][j] = 0;
+				for (int k = 0; k < DP; k++)
+					temp2[i][j] += measurementMatrix[i][k] * errorCovPre[k][j];
+			}
+
+		// temp3 = temp2*Ht + R
+		float temp3[MP][MP];
+		for (int i = 0; i < MP; i++)
+			for (int j = 0; j < MP; j++)
+			{
+				temp3[i][j] = measurementNoiseCov[i][j];
+				for (int k = 0; k < DP; k++)
+					temp3[i][j] += temp2[i][k] * measurementMatrix[j][k];
+			}
+
+		// temp4 = inv(temp3)*temp2 = Kt(k)
+		float temp4[MP][DP];
+		if (MP == 1)
+		{
+			//closed form for scalar measurements
+			float inv_s = temp3[0][0] != 0 ? 1.f / temp3[0][0] : 0.f;
+			for (int j = 0; j < DP; j++)
+				temp4[0][j] = temp2[0][j] * inv_s;
+		}
+		else if (!solve(temp3, temp2, temp4))
+			return statePost;
+
+		// x(k) = x'(k) + K(k)*y, P(k) = P'(k) - K(k)*temp2
+		for (int i = 0; i < DP; i++)
+		{
+			float x = statePre[i];
+			for (int k = 0; k < MP; k++)
+				x += temp4[k][i] * y[k];
+			statePost[i] = x;
+			for (int j = 0; j < DP; j++)
+			{
+				float p = errorCovPre[i][j];
+				for (int k = 0; k < MP; k++)
+					p -= temp4[k][i] * temp2[k][j];
+				errorCovPost[i][j] = p;
+			}
+		}
+		return statePost;
+	}
+
+	const float* correct(float y)
+	{
+		float y_[MP] = { y };
+		return correct(y_);
+	}
+
+	//batch update in information form, for measurements linearized at x_lin :
+	//J = sum(Ht*inv(R)*H), g = sum(Ht*inv(R)*(y + H*(x_lin - x'(k)))).
+	//P(k) = inv(inv(P'(k)) + J), x(k) = x'(k) + P(k)*g. false if a matrix is singular.
+	bool correctInformation(const double J[DP][DP], const double g[DP])
+	{
+		double Y[DP][DP];
+		for (int i = 0; i < DP; i++)
+			for (int j = 0; j < DP; j++)
+				Y[i][j] = errorCovPre[i][j];
+		if (!invert(Y))
+			return false;
+		for (int i = 0; i < DP; i++)
+			for (int j = 0; j < DP; j++)
+				Y[i][j] += J[i][j];
+		if (!invert(Y))
+			return false;
+		for (int i = 0; i < DP; i++)
+		{
+			double x = statePre[i];
+			for (int j = 0; j < DP; j++)
+			{
+				x += Y[i][j] * g[j];
+				errorCovPost[i][j] = (float)Y[i][j];
+			}
+			statePost[i] = (float)x;
+		}
+		return true;
+	}
+
+	float residual(float measurement, float hx) { return measurement - hx; }
+
+	float statePre[DP];                   //!< predicted state (x'(k)): x(k)=A*x(k-1)
+	float statePost[DP];                  //!< corrected state (x(k)): x(k)=x'(k)+K(k)*(z(k)-h(x'(k)))
+	float transitionMatrix[DP][DP];       //!< state transition matrix (A)
+	float measurementMatrix[MP][DP];      //!< measurement matrix (H), jacobian of h at x'(k)
+	float processNoiseCov[DP][DP];        //!< process noise covariance matrix (Q)
+	float measurementNoiseCov[MP][MP];    //!< measurement noise covariance matrix (R)
+	float errorCovPre[DP][DP];            //!< priori error estimate covariance matrix (P'(k))
+	float errorCovPost[DP][DP];           //!< posteriori error estimate covariance matrix (P(k))
+
+private:
+	//M = inv(M), Gauss-Jordan with partial pivoting
+	static bool invert(double M[DP][DP])
+	{
+		double I[DP][DP];
+		for (int i = 0; i < DP; i++)
+			for (int j = 0; j < DP; j++)
+				I[i][j] = (i == j) ? 1 : 0;
+		for (int c = 0; c < DP; c++)
+		{
+			int p = c;
+			for (int r = c + 1; r < DP; r++)
+				if (std::abs(M[r][c]) > std::abs(M[p][c]))
+					p = r;
+			if (std::abs(M[p][c]) < 1e-300)
+				return false;
+			for (int j = 0; j < DP; j++) std::swap(M[c][j], M[p][j]), std::swap(I[c][j], I[p][j]);
+			double inv_p = 1.0 / M[c][c];
+			for (int j = 0; j < DP; j++) M[c][j] *= inv_p, I[c][j] *= inv_p;
+			for (int r = 0; r < DP; r++)
+			{
+				if (r == c) continue;
+				double f = M[r][c];
+				for (int j = 0; j < DP; j++) M[r][j] -= f * M[c][j], I[r][j] -= f * I[c][j];
+			}
+		}
+		for (int i = 0; i < DP; i++)
+			for (int j = 0; j < DP; j++)
+				M[i][j] = I[i][j];
+		return true;
+	}
+
+	//X = inv(A)*B with Gauss elimination and partial pivoting, A is destroyed
+	static bool solve(float A[MP][MP], const float B[MP][DP], float X[MP][DP])
+	{
+		for (int i = 0; i < MP; i++)
+			for (int j = 0; j < DP; j++)
+				X[i][j] = B[i][j];
+		for (int c = 0; c < MP; c++)
+		{
+			int p = c;
+			for (int r = c + 1; r < MP; r++)
+				if (std::abs(A[r][c]) > std::abs(A[p][c]))
+					p = r;
+			if (std::abs(A[p][c]) < 1e-12f)
+				return false;
+			for (int j = 0; j < MP; j++) std::swap(A[c][j], A[p][j]);
+			for (int j = 0; j < DP; j++) std::swap(X[c][j], X[p][j]);
+			for (int r = 0; r < MP; r++)
+			{
+				if (r == c) continue;
+				float f = A[r][c] / A[c][c];
+				for (int j = 0; j < MP; j++) A[r][j] -= f * A[c][j];
+				for (int j = 0; j < DP; j++) X[r][j] -= f * X[c][j];
+			}
+		}
+		for (int c = 0; c < MP; c++)
+			for (int j = 0; j < DP; j++)
+				X[c][j] /= A[c][c];
+		return true;
+	}
+};
@@ -0,0 +1,74 @@
+#include "GroundSampler.h"
+#include <cstring>
+using namespace std;
+
+GroundSampler::GroundSampler(double _cell_x, double _cell_z)
+{
+	cell_x = _cell_x;
+	cell_z = _cell_z;
+	ipm = NULL;
+	x_min = z_min = 0;
+	cols = rows = 0;
+	n_cells = 0;
+	stamp = 0;
+}
+
+void GroundSampler::reset(const CC::CC_SimpleIPM &_ipm, const Mat &_colorImage, double _x_min, double _x_max, double _z_min, double _z_max)
+{
+	ipm = &_ipm;
+	colorImage = _colorImage;
+	x_min = _x_min;
+	z_min = _z_min;
+	cols = (int)ceil((_x_max - _x_min) / cell_x);
+	rows = (int)ceil((_z_max - _z_min) / cell_z);
+	stamp++;
+	if (n_cells != cols * rows || stamp == 0)
+	{
+		if (n_cells != cols * rows)
+		{
+			n_cells = cols * rows;
+			cells.reset(new std::atomic<uint64_t>[n_cells]);
+		}
+		for (int k = 0; k < n_cells; k++)
+			cells[k].store(0, std::memory_order_relaxed);
+		stamp = 1;
+	}
+}
+
+bool GroundSampler::project(double x, double z, float &gray) const
+{
+	double u, v;
+	ipm->convert_inv(x, z, u, v);
+	if (v < 0 || v > colorImage.rows - 1)
+		return false;
+	if (u < 0 || u > colorImage.cols - 1)
+		return false;
+	const Vec3b &c = colorImage.at<Vec3b>((int)v, (int)u);
+	gray = (float)(0.114 * c[0] + 0.587 * c[1] + 0.299 * c[2]);
+	return true;
+}
+
+bool GroundSampler::sample(double x, double z, float &gray)
+{
+	int c = (int)floor((x - x_min) / cell_x);
+	int r = (int)floor((z - z_min) / cell_z);
+	if (c < 0 || c >= cols || r < 0 || r >= rows)
+		return project(x, z, gray);
+
+	std::atomic<uint64_t> &cell = cells[r * cols + c];
+	uint64_t value = cell.load(std::memory_order_relaxed);
+	if ((uint32_t)(value >> 32) != stamp)
+	{
+		//center of the cell, several threads may write the same value
+		uint32_t g = OUT_OF_IMAGE;
+		if (project(x_min + (c + 0.5) * cell_x, z_min + (r + 0.5) * cell_z, gray))
+			memcpy(&g, &gray, sizeof(g));
+		value = ((uint64_t)stamp << 32) | g;
+		cell.store(value, std::memory_order_relaxed);
+	}
+	uint32_t g = (uint32_t)value;
+	if (g == OUT_OF_IMAGE)
+		return false;
+	memcpy(&gray, &g, sizeof(gray));
+	return true;
+}
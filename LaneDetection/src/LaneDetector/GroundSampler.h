@@ -0,0 +1,39 @@
+#pragma once
+
+#include <opencv2\opencv.hpp>
+#include "../ConverterCoordinates/CC.h"
+#include <atomic>
+#include <memory>
+using namespace cv;
+
+//GroundSampler gives the gray level of the image at a point (x, z) of the ground plane of ipm.
+//The ground zone is a grid of cells (cell_x, cell_z) m, each cell is projected to the image the
+//first time it is asked for and kept until the next reset(), so that sampling the same road
+//again (overlapping pairs, second findPairs) is a table lookup. Points out of the zone are
+//projected each time. sample() may be called from several threads between two reset(),
+//a cell holds its stamp and its gray level (the float of project()) in one 64 bits atomic word.
+class GroundSampler {
+public:
+	GroundSampler(double _cell_x = 0.025, double _cell_z = 0.1);
+
+	//new image or new ipm model : forget the cells (no clearing, the cells carry the stamp of their reset).
+	//not concurrently with sample()
+	void reset(const CC::CC_SimpleIPM &_ipm, const Mat &_colorImage, double _x_min, double _x_max, double _z_min, double _z_max);
+
+	//gray level 0.114 B + 0.587 G + 0.299 R at the ground point, false if it is out of the image
+	bool sample(double x, double z, float &gray);
+
+	double cell_x, cell_z;
+
+private:
+	bool project(double x, double z, float &gray) const;
+
+	const CC::CC_SimpleIPM *ipm;
+	Mat colorImage;
+	double x_min, z_min;
+	int cols, rows;
+	int n_cells;
+	uint32_t stamp;//the cells are cleared when it wraps
+	std::unique_ptr<std::atomic<uint64_t>[]> cells;//stamp << 32 | bits of the float gray, OUT_OF_IMAGE
+	static const uint32_t OUT_OF_IMAGE = 0xFFFFFFFF;//a NaN, never a gray level
+};
@@ -1,7 +1,13 @@
 #include "LaneDetectionV2.h"
+#include "../ELAS_VisualOdometry/AsyncProcessVISO.h"
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <algorithm>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define EKF_USE_SSE2
+#endif
 using namespace std;
 #define EPS_HERE 1.0e-2
 #define INFINI_HERE 1.0e6
@@ -95,7 +101,28 @@ Point2d foot_p2line(Point2d p, Segment2d seg) {
 	return Point2d(foot_x, foot_y);
 }
 
+Segment2d::Segment2d()
+{
+	indexZone[0] = indexZone[1] = indexZone[2] = indexZone[3] = 0;
+	slope = length = 0;
+	_scale = 3;
+}
+
 Segment2d::Segment2d(Point2d _p1, Point2d _p2, int scale)
+{
+	setEnds(_p1, _p2, scale);
+	slope = slope_seg(p1, p2);
+	length = dist_p2p(p1, p2);
+}
+
+Segment2d::Segment2d(Point2d _p1, Point2d _p2, double _slope, double _length, int scale)
+{
+	setEnds(_p1, _p2, scale);
+	slope = _slope;
+	length = _length;
+}
+
+void Segment2d::setEnds(Point2d _p1, Point2d _p2, int scale)
 {
 	_scale = scale;
 	if (_p1.y < _p2.y)
@@ -121,18 +148,6 @@ Segment2d::Segment2d(Point2d _p1, Point2d _p2, int scale)
 		indexZone[2] = (int)p2.x / scale;
 		indexZone[3] = (int)p1.x / scale;
 	}
-	_ini_slope = false;
-	_ini_length = false;
-}
-
-void Segment2d::computeSlope() {
-	slope = slope_seg(p1, p2);
-	_ini_slope = true;
-}
-
-void Segment2d::computeLength() {
-	length = dist_p2p(p1, p2);
-	_ini_length = true;
 }
 
 double Segment2d::computeDistance(Point2d p)
@@ -466,45 +481,85 @@ LaneDetection::LaneDetection(const Mat &img) {
 		
 	kf.statePost = (Mat_<float>(2, 1) << vp.x, vp.y);
 
-	ekf.init(2, 1, 0);
-	ekf.transitionMatrix = (Mat_<float>(2, 2) << 1, 0, 0, 1);
-	setIdentity(ekf.processNoiseCov, Scalar::all(10));
-	setIdentity(ekf.errorCovPost, Scalar::all(100));
-	ekf.statePost = (Mat_<float>(2, 1) << vp.x, vp.y);
+	ekf.init();
+	ekf.setIdentity(ekf.processNoiseCov, 10);
+	ekf.setIdentity(ekf.errorCovPost, 100);
+	ekf.statePost[0] = vp.x;
+	ekf.statePost[1] = vp.y;
+
+	odometry = NULL;
+	ekfInterval = 10;
+	frameCount = 0;
+
+	pairThreads = 0;
+	pairCache.valid = false;
+	pairCache.max_rx_delta = 0.5 * CV_PI / 180;
+	tracking = false;
+	corridorSearch = false;
+	egoMotionExternal = false;
+	groundPlaneExternal = false;
+	groundPitch = groundHeight = 0;
 }
 
-ntuple_list LaneDetection::resultLSD() {
+const SegmentTable &LaneDetection::resultLSD() {
 	unsigned int X = rawGrayImage.cols;
 	unsigned int Y = rawGrayImage.rows;
 	unsigned int XY = X * Y;
 
-	image_double image = new_image_double(X, Y);
+	lsdSegments.clear();
+	pairCache.valid = false;
+
+	image_double image;
+	if (corridorSearch)
+	{
+		vector<Rect> rois;
+		laneTracker.getROIs(*ipm, rawGrayImage.size(), z_min, z_max, rois);
+
+		//segments of all ROIs, in image coordinates
+		for (size_t r = 0; r < rois.size(); r++)
+		{
+			image = new_image_double(rois[r].width, rois[r].height);
+			for (int y = 0; y < rois[r].height; y++)
+			{
+				const uchar* ptr_row_gray = rawGrayImage.ptr<uchar>(rois[r].y + y) + rois[r].x;
+				double* ptr_row_image = image->data + y * rois[r].width;
+				for (int x = 0; x < rois[r].width; x++)
+					ptr_row_image[x] = (double)ptr_row_gray[x];
+			}
+			ntuple_list roi_result = lsd(image);
+			free_image_double(image);
+
+			lsdSegments.appendLSD(roi_result, rois[r].x, rois[r].y);
+			free_ntuple_list(roi_result);
+		}
+		return lsdSegments;
+	}
+
+	image = new_image_double(X, Y);
 	
 	const uchar* ptr_gray_image = rawGrayImage.ptr<uchar>(0);
 	for (int _pixel = 0; _pixel < XY; _pixel++)
 	{
 		image->data[_pixel] = (double)ptr_gray_image[_pixel];
 	}
-	if (lsd_result == NULL || lsd_result->values == NULL)
-		;
-	else
-		free_ntuple_list(lsd_result);
 
-	lsd_result = lsd(image);
+	ntuple_list lsd_result = lsd(image);
+	lsdSegments.appendLSD(lsd_result);
+	free_ntuple_list(lsd_result);
 
 #ifdef DEBUG_drawImage
 	Mat colorImage;
 	rawColorImage.copyTo(colorImage);
 	/*draw the lines*/
-	for (int i = 0; i < lsd_result->size; i++)
+	for (int i = 0; i < lsdSegments.size(); i++)
 	{
 		int b = (unsigned)theRNG() & 255;
 		int g = i & 255;
 		int r = i / 255;
-		int thickness = (int)lsd_result->values[i * lsd_result->dim + 4] / 2;
+		int thickness = (int)lsdSegments.width[i] / 2;
 		int lineType = 8;
-		Point start = cv::Point(lsd_result->values[i * lsd_result->dim + 0] + 0.5, lsd_result->values[i * lsd_result->dim + 1] + 0.5),
-			end = cv::Point(lsd_result->values[i * lsd_result->dim + 2] + 0.5, lsd_result->values[i * lsd_result->dim + 3] + 0.5);
+		Point start = cv::Point(lsdSegments.u1[i] + 0.5, lsdSegments.v1[i] + 0.5),
+			end = cv::Point(lsdSegments.u2[i] + 0.5, lsdSegments.v2[i] + 0.5);
 
 		line(colorImage, start, end, Scalar(b, g, r), 1, lineType);
 	}
@@ -513,7 +568,7 @@ ntuple_list LaneDetection::resultLSD() {
 	/* free memory */
 	free_image_double(image);
 
-	return lsd_result;
+	return lsdSegments;
 }
 
 void LaneDetection::updateIPM(vector<Pair2d> pairs, vector<Pair2d> pairs_in_image)
@@ -643,6 +698,48 @@ float hx(Point2d vp, Point2d m)
 	return atan((vp.y - m.y) / (vp.x - m.x));
 }
 
+//J = sum(w * H' * H), g = sum(w * r * H') for the rows H = (h0, h1), two rows per step
+static void accumulateInformation(const double *h0, const double *h1, const double *w, const double *r, int n,
+	double J[2][2], double g[2])
+{
+	J[0][0] = J[0][1] = J[1][1] = 0;
+	g[0] = g[1] = 0;
+	int i = 0;
+#ifdef EKF_USE_SSE2
+	__m128d j00 = _mm_setzero_pd(), j01 = _mm_setzero_pd(), j11 = _mm_setzero_pd();
+	__m128d g0 = _mm_setzero_pd(), g1 = _mm_setzero_pd();
+	for (; i + 2 <= n; i += 2)
+	{
+		__m128d a = _mm_loadu_pd(h0 + i), b = _mm_loadu_pd(h1 + i);
+		__m128d wa = _mm_mul_pd(_mm_loadu_pd(w + i), a), wb = _mm_mul_pd(_mm_loadu_pd(w + i), b);
+		__m128d ri = _mm_loadu_pd(r + i);
+		j00 = _mm_add_pd(j00, _mm_mul_pd(wa, a));
+		j01 = _mm_add_pd(j01, _mm_mul_pd(wa, b));
+		j11 = _mm_add_pd(j11, _mm_mul_pd(wb, b));
+		g0 = _mm_add_pd(g0, _mm_mul_pd(wa, ri));
+		g1 = _mm_add_pd(g1, _mm_mul_pd(wb, ri));
+	}
+	double s[5][2];
+	_mm_storeu_pd(s[0], j00), _mm_storeu_pd(s[1], j01), _mm_storeu_pd(s[2], j11);
+	_mm_storeu_pd(s[3], g0), _mm_storeu_pd(s[4], g1);
+	J[0][0] = s[0][0] + s[0][1];
+	J[0][1] = s[1][0] + s[1][1];
+	J[1][1] = s[2][0] + s[2][1];
+	g[0] = s[3][0] + s[3][1];
+	g[1] = s[4][0] + s[4][1];
+#endif
+	for (; i < n; i++)
+	{
+		double wa = w[i] * h0[i], wb = w[i] * h1[i];
+		J[0][0] += wa * h0[i];
+		J[0][1] += wa * h1[i];
+		J[1][1] += wb * h1[i];
+		g[0] += wa * r[i];
+		g[1] += wb * r[i];
+	}
+	J[1][0] = J[0][1];
+}
+
 void LaneDetection::updateIPM2(vector<Pair2d> pairs_in_image)
 {
 	vector<Segment2d> segments_in_image;
@@ -666,33 +763,59 @@ void LaneDetection::updateIPM2(vector<Pair2d> pairs_in_image)
 		return;
 
 
-	Mat prex = ekf.predict();
-	Point2d prevp(prex.at<float>(0), prex.at<float>(1));
+	//measurement of a segment : its angle, seen from the middle point mi as the direction to vp.
+	//the angle, middle point, 1 / length^2 and 1 / noise don't depend on vp
 	double leng_max = 700;
+	for (int i = 0; i < n_size; i++)
+		leng_max = max(leng_max, segments_in_image[i].getLength());
+
+	vector<double> theta(n_size), mx(n_size), my(n_size), inv_d2(n_size), inv_r(n_size);
+	for (int i = 0; i < n_size; i++)
+	{
+		Segment2d *s = &segments_in_image[i];
+		Point2d mi = 0.5*(s->p1 + s->p2);
+		double len = s->getLength();
+		theta[i] = atan(s->getSlope());
+		mx[i] = mi.x;
+		my[i] = mi.y;
+		inv_d2[i] = 1.0 / (len * len);
+		inv_r[i] = 1.0 / ((20 - len * 19.0 / leng_max) * CV_PI / 180);
+	}
+
+	//iterated update : all the segments are linearized at the same point (the prediction, then
+	//the estimate of the first iteration) and accumulated in information form, then the 2x2
+	//system is solved once per iteration
+	const float *prex = ekf.predict();
+	Point2d prevp(prex[0], prex[1]);
+	Point2d x_lin = prevp;
+	vector<double> h0(n_size), h1(n_size), w(n_size), r(n_size);
 	for (int n_iter = 0; n_iter < 2; n_iter++)
 	{
+		int n_in = 0;
 		for (int i = 0; i < n_size; i++)
 		{
-			prevp = Point2d(ekf.statePre.at<float>(0), ekf.statePre.at<float>(1));
-			Segment2d *s = &segments_in_image[i];
-			Point2d mi = 0.5*(s->p1 + s->p2);
-			//cout << atan(s->getSlope()) << ";;;;;" << hx(prevp, mi) << endl;
-			float yi = ekf.residual(atan(s->getSlope()), hx(prevp, mi));
+			Point2d mi(mx[i], my[i]);
+			float yi = ekf.residual((float)theta[i], hx(x_lin, mi));
 			if (abs(yi) > CV_PI / 9)
 				continue;
 
-			float d2 = pow(s->getLength(), 2);
-			if (leng_max < s->getLength())
-			{
-				leng_max = s->getLength();
-			}
-			ekf.measurementMatrix = (Mat_<float>(1, 2) << (mi.y - prevp.y) / d2, (prevp.x - mi.x) / d2);
-			ekf.measurementNoiseCov = (20 - s->getLength() * 19.0 / leng_max) * CV_PI / 180;
-			//cout << s->getLength() << "  " << ekf.measurementNoiseCov << endl;
-			ekf.correct().copyTo(ekf.statePre);
+			h0[n_in] = (mi.y - x_lin.y) * inv_d2[i];
+			h1[n_in] = (x_lin.x - mi.x) * inv_d2[i];
+			w[n_in] = inv_r[i];
+			//measurement relative to the prediction : y + H * (x_lin - x')
+			r[n_in] = yi + h0[n_in] * (x_lin.x - prevp.x) + h1[n_in] * (x_lin.y - prevp.y);
+			n_in++;
 		}
+		if (n_in == 0)
+			break;
+
+		double J[2][2], g[2];
+		accumulateInformation(&h0[0], &h1[0], &w[0], &r[0], n_in, J, g);
+		if (!ekf.correctInformation(J, g))
+			break;
+		x_lin = Point2d(ekf.statePost[0], ekf.statePost[1]);
 	}
-	float *ptr_vp = ekf.statePost.ptr<float>(0);
+	float *ptr_vp = ekf.statePost;
 	//cout << "nb " << nb << endl;
 	if (ptr_vp[1] > rawImage.rows * 0.7)
 	{
@@ -719,6 +842,80 @@ void LaneDetection::updateIPM2(vector<Pair2d> pairs_in_image)
 	//cout << "rx :    -------------  " << rx << endl;
 }
 
+bool LaneDetection::updateIPMFromOdometry()
+{
+	Matrix44 motion;
+	if (odometry == NULL || !odometry->waitMotion(motion))
+		return false;
+
+	//the ipm model has no roll
+	double d_pitch, d_roll;
+	AsyncProcessVISO::motionToPitchRoll(motion, d_pitch, d_roll);
+
+	double fx, fy, cu, cv;
+	ipm->getCameraParam(fx, fy, cu, cv);
+	double rx, h;
+	ipm->getRxAndH(rx, h);
+	rx += d_pitch;
+
+	//same bounds as updateIPM2
+	double f = (fx + fy) / 2;
+	double vpy = cv - f * tan(rx);
+	vpy = max(rawImage.rows * 0.3, min(rawImage.rows * 0.7, vpy));
+	rx = atan2(cv - vpy, f);
+	ipm->createModel(fx, fy, cu, cv, rx, h);
+
+	//keep the EKF state on the odometry, so that the next drift correction starts from here
+	vp.y = vpy;
+	ekf.statePost[1] = (float)vpy;
+
+	if (tracking && !egoMotionExternal)
+		laneTracker.setMotion(motion);//for the prediction of the next frame
+	return true;
+}
+
+bool LaneDetection::updateIPMFromGroundPlane()
+{
+	if (!groundPlaneExternal)
+		return false;
+	groundPlaneExternal = false;
+
+	double fx, fy, cu, cv;
+	ipm->getCameraParam(fx, fy, cu, cv);
+	ipm->createModel(fx, fy, cu, cv, groundPitch, groundHeight);
+
+	//keep the EKF state on the measured pitch, for the frames without it
+	double f = (fx + fy) / 2;
+	vp.y = cv - f * tan(groundPitch);
+	ekf.statePost[1] = (float)vp.y;
+	return true;
+}
+
+void LaneDetection::startTracking()
+{
+	corridorSearch = false;
+	if (!tracking)
+		return;
+
+	laneTracker.predict();
+	corridorSearch = !laneTracker.needFullSearch();
+	egoMotionExternal = false;
+}
+
+void LaneDetection::updateTracking(const vector<Pair2d> &pairs)
+{
+	if (!tracking)
+		return;
+
+	vector<Vec4d> lines;
+	for (int i = 0; i < pairs.size(); i++)
+	{
+		const Segment2d &s = pairs[i]._p12;
+		lines.push_back(Vec4d(s.p1.x, s.p1.y, s.p2.x, s.p2.y));
+	}
+	laneTracker.update(lines, !corridorSearch);
+}
+
 
 void LaneDetection::detectionLineLSD(Mat &resultImage) {
 	unsigned int X = rawGrayImage.cols;  /* x image size */
@@ -807,13 +1004,12 @@ void LaneDetection::method2(const Mat &img)
 
 	vector<Segment2d> segments;
 	vector<Segment2d> segments_in_image;
-	int dim = lsd_result->dim;
 
-	for (int i = 0; i < lsd_result->size; i++)
+	for (int i = 0; i < lsdSegments.size(); i++)
 	{
 		double x, z;
-		double u = lsd_result->values[i * lsd_result->dim + 0];
-		double v = lsd_result->values[i * lsd_result->dim + 1];
+		double u = lsdSegments.u1[i];
+		double v = lsdSegments.v1[i];
 		Point2d p1_in_image(u, v);
 		ipm->convert(u, v, x, z);
 		if (x < x_min || x > x_max)
@@ -823,8 +1019,8 @@ void LaneDetection::method2(const Mat &img)
 
 		Point2d p1(x, z);
 
-		u = lsd_result->values[i * lsd_result->dim + 2];
-		v = lsd_result->values[i * lsd_result->dim + 3];
+		u = lsdSegments.u2[i];
+		v = lsdSegments.v2[i];
 		Point2d p2_in_image(u, v);
 		ipm->convert(u, v, x, z);
 		if (x < x_min || x > x_max)
@@ -1017,49 +1213,37 @@ void LaneDetection::method2(const Mat &img)
 	t1 = getTickCount();
 	cout << "final : " << (t1 - t0) / getTickFrequency() * 1000 << " ms. " << endl;
 
-	free_ntuple_list(lsd_result);
 	delete drawn;
 }
 
 
-void LaneDetection::findPairs(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_image, const Mat &maskRoad, int times)
+void LaneDetection::projectSegments(SegmentTable &view)
 {
-	pairs.clear();
-	pairs_in_image.clear();
+	groundSampler.reset(*ipm, rawColorImage, x_min - 1, x_max + 1, z_min, z_max);
+
+	view.clear();
+	view.reserve(lsdSegments.size());
 
 	//select segments in this zone
 	//int x_min = -20, x_max = 15;
 	//int z_min = 6, z_max = 80;
 
-	vector<Segment2d> segments_in_image;
-	vector<Segment2d> segments;
-
-	int num_sample = 10;
-	for (int i = 0; i < lsd_result->size; i++)
+	for (int i = 0; i < lsdSegments.size(); i++)
 	{
 		double x, z;
-		double u = lsd_result->values[i * lsd_result->dim + 0];
-		double v = lsd_result->values[i * lsd_result->dim + 1];
-		Point2d p1_in_image(u, v);
-		ipm->convert(u, v, x, z);
+		ipm->convert(lsdSegments.u1[i], lsdSegments.v1[i], x, z);
 		bool b1 = x > x_min && x < x_max && z > z_min && z < z_max;
-		Point2d p1(x, z);
 
-		double u2 = lsd_result->values[i * lsd_result->dim + 2];
-		double v2 = lsd_result->values[i * lsd_result->dim + 3];
-		Point2d p2_in_image(u2, v2);
-		ipm->convert(u2, v2, x, z);
-		bool b2 = x > x_min && x < x_max && z > z_min && z < z_max;
-		Point2d p2(x, z);
+		double x2, z2;
+		ipm->convert(lsdSegments.u2[i], lsdSegments.v2[i], x2, z2);
+		bool b2 = x2 > x_min && x2 < x_max && z2 > z_min && z2 < z_max;
 
-		bool b_mask = true;
+		//corridor search : the middle of the segment must be close to a tracked lane
+		bool b_mask = !corridorSearch || laneTracker.inCorridor((x + x2) / 2, (z + z2) / 2);
 
 
 		if ( (b1 || b2) && b_mask)
-		{
-			segments.push_back(Segment2d(p1, p2));
-			segments_in_image.push_back(Segment2d(p1_in_image, p2_in_image));
-		}
+			view.appendProjected(lsdSegments, i, x, z, x2, z2);
 
 	}
 
@@ -1067,450 +1251,449 @@ void LaneDetection::findPairs(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_im
 	Mat colorImage;
 	rawColorImage.copyTo(colorImage);
 	/*draw the lines*/
-	for (int i = 0; i < segments_in_image.size(); i++)
+	for (int i = 0; i < view.size(); i++)
 	{
-		Segment2d *p12 = &segments_in_image[i];//p1.y < p2.y
 		int g = i & 255;
 		int r = i / 255;
 
-		line(colorImage, p12->p1, p12->p2, Scalar(255, g, r), 1);
+		line(colorImage, Point2d(view.u1[i], view.v1[i]), Point2d(view.u2[i], view.v2[i]), Scalar(255, g, r), 1);
 	}
 	imwrite("inViewSegments.png", colorImage);
 #endif
+}
 
-	vector<double> slopes;
-	
+bool LaneDetection::evaluatePair(const SegmentTable &view, int i, int j, vector<PairCandidate> &candidates)
+{
+#ifdef DEBUG_FOUT
+	Segment2d p12_img = view.image(i);
+	Segment2d seg_img = view.image(j);
+#endif
 
-	//step 3 : find pairs
-	int n_segments = segments.size();
-	int **pair_relation = new int*[n_segments];//index of pair of ith segment and jth segment. If they are not, it's -1.
-	for (int i = 0; i < n_segments; i++)
+	//several conditions, on the columns of the table : most of the pairs stop here
+	if (!view.maybePair(i, j))
 	{
-		pair_relation[i] = new int[n_segments];
-		for (int j = 0; j < n_segments; j++)
-		{
-			pair_relation[i][j] = -1;
-		}
+#ifdef DEBUG_FOUT
+		fout_2 << "!p12->maybePair(seg)  " << endl;
+		fout_2 << i << "," << j << "[" << p12_img.p1 << "," << p12_img.p2 << "] and [" << seg_img.p1 << "," << seg_img.p2 << endl;
+#endif
+		return false;
 	}
+		
 
+	
 
-	int width = 1;
-	for (int i = 0; i < n_segments; i++)
+	Segment2d p12 = view.ground(i);//p1.y < p2.y
+	Segment2d seg = view.ground(j);
+	vector<Segment2d> entire_v = p12.getValidRect(seg);
+	//valid?
+	if (entire_v.empty())
 	{
-		Segment2d *p12 = &segments[i];//p1.y < p2.y
-		if (p12->p1.y < 0)
-		{
 #ifdef DEBUG_FOUT
-			fout_2 << "p12->p1.y < 0  " << endl;
-			fout_2 << i << "," << endl;
+		fout_2 << i << ", " << j << "continue in v.empty()"  << endl;
+		fout_2 << i << "," << j << "[" << p12_img.p1 << "," << p12_img.p2 << "] and [" << seg_img.p1 << "," << seg_img.p2 << endl;
 #endif
-			continue;
-		}
-			
+		return false;
+	}
+	double d1 = dist_p2p(entire_v[0].p1, entire_v[1].p1);
+	if (d1 < 0.1)
+	{
+#ifdef DEBUG_FOUT
+		fout_2 << "d1 < 0.1  " << endl;
+		fout_2 << i << "," << j << "[" << p12_img.p1 << "," << p12_img.p2 << "] and [" << seg_img.p1 << "," << seg_img.p2 << endl;
+#endif
+		return false;
+	}
 
-		Segment2d *p12_img = &segments_in_image[i];
+	//color compare
+	Point2d translation[3];
+	translation[0] = Point2d(0, 0);
+	translation[1] = entire_v[0].p1 - entire_v[1].p1;
+	translation[2] = -translation[1];
+	if (translation[1].x > 0)
+	{
+		translation[2] = entire_v[0].p1 - entire_v[1].p1;
+		translation[1] = -translation[2];
+	}
 
-		int num_group_p12 = 0;
-		for (int j = 0; j < n_segments; j++)
+	//translation[1] -= Point2d(0.1, 0);
+	//translation[2] += Point2d(0.1, 0);
+
+	Point2d src_p[4];
+	for (int i = 0; i < 2; i++)
+	{
+		for (int j = 0; j < 2; j++)
 		{
-			if (j == i) continue;
-			Segment2d *seg = &segments[j];
-			Segment2d *seg_img = &segments_in_image[j];
+			j == 0 ? src_p[i * 2 + j] = entire_v[i].p1 : src_p[i * 2 + j] = entire_v[i].p2;
+		}
+	}
 
-			//several conditions
-			if (!p12->maybePair(seg))
-			{
+	//mean gray level of the center of the pair and of the middles center - corners,
+	//on the pair and on both sides
+	double g[3];//mean gray color in three rectangles
+	Point2d center = (src_p[0] + src_p[1] + src_p[2] + src_p[3]) / 4;
+	for (int _trans = 0; _trans < 3; _trans++)
+	{
+		Point2d trans = translation[_trans];
+		float sum = 0, gray;
+		int n_sample = 0;
+		if (groundSampler.sample(center.x + trans.x, center.y + trans.y, gray))
+			sum += gray, n_sample++;
+		for (int n = 0; n < 4; n++)
+		{
+			Point2d _p_sample = (center + src_p[n]) / 2 + trans;
+			if (groundSampler.sample(_p_sample.x, _p_sample.y, gray))
+				sum += gray, n_sample++;
+		}
+		g[_trans] = n_sample > 0 ? sum / n_sample : 0;
+	}
+	bool color_matched = g[0] > g[1] + 10 && g[0] > g[2] + 10;
+	//for (int g_n = 0; g_n < 3; g_n++)
+	//{
+	//	color_matched = color_matched &&
+	//		mean_color[0][g_n] > mean_color[1][g_n] + 10
+	//		&& mean_color[0][g_n] > mean_color[2][g_n] + 10;
+	//}
+
+	//color_matched = color_matched && abs(mean_color[0][0] - mean_color[0][1]) < 50
+	//	&& abs(mean_color[0][0] - mean_color[0][2]) < 50;
+
+	//bool color_matched = (g[0] > g[1] + 10) && (g[0] > g[2] + 10);
+	if (!color_matched)
+	{
+		//fout_2 << p1 << p2 << seg1 << seg2 << mean_color[0] << "," << mean_color[1] << "," << mean_color[2];
+		//fout_2 << "," << stdDev_color[0] << endl;
+		//fout_2 << "continue in color_matched" << endl;
 #ifdef DEBUG_FOUT
-				fout_2 << "!p12->maybePair(seg)  " << endl;
-				fout_2 << i << "," << j << "[" << p12_img->p1 << "," << p12_img->p2 << "] and [" << seg_img->p1 << "," << seg_img->p2 << endl;
+		fout_2 << "!color_matched  " << endl;
+		fout_2 << i << "," << j << "[" << p12_img.p1 << "," << p12_img.p2 << "] and [" << seg_img.p1 << "," << seg_img.p2 << endl;
 #endif
-				continue;
-			}
-				
+		return false;
+	}
 
-			
+	Pair2d pair2d(p12, seg, entire_v[0].p1, entire_v[0].p2, entire_v[1].p1, entire_v[1].p2);
+	Pair2d pair2d_img(view.image(i), view.image(j));
+	double mean_width = d1;
+	pair2d.setMeanWidth(mean_width);
+	pair2d.setMeanColor(g[0]);
+	pair2d.computeLineModel();
+	candidates.push_back(PairCandidate(i, j, pair2d, pair2d_img));
+	return true;
+}
 
-			vector<Segment2d> entire_v = p12->getValidRect(*seg);
-			//valid?
-			if (entire_v.empty())
+//evaluatePair on stripes of the search : rows i of the full search, or parts of the list ij.
+//each stripe has its own candidates, in the serial order
+class EvaluatePairsBody : public ParallelLoopBody {
+public:
+	EvaluatePairsBody(LaneDetection *_ld, const SegmentTable &_view,
+		const vector<Point> *_ij, int _n_stripes, vector<vector<LaneDetection::PairCandidate> > &_stripe_candidates) :
+		ld(_ld), view(_view), ij(_ij), n_stripes(_n_stripes), stripe_candidates(_stripe_candidates) {}
+
+	void operator()(const Range &range) const
+	{
+		int n_segments = view.size();
+		for (int s = range.start; s < range.end; s++)
+		{
+			vector<LaneDetection::PairCandidate> &candidates = stripe_candidates[s];
+			if (ij == NULL)
 			{
+				for (int i = n_segments * s / n_stripes; i < n_segments * (s + 1) / n_stripes; i++)
+				{
+					if (view.z1[i] < 0)
+					{
 #ifdef DEBUG_FOUT
-				fout_2 << i << ", " << j << "continue in v.empty()"  << endl;
-				fout_2 << i << "," << j << "[" << p12_img->p1 << "," << p12_img->p2 << "] and [" << seg_img->p1 << "," << seg_img->p2 << endl;
+						fout_2 << "p12->p1.y < 0  " << endl;
+						fout_2 << i << "," << endl;
 #endif
-				continue;
+						continue;
+					}
+
+					for (int j = 0; j < n_segments; j++)
+					{
+						if (j == i) continue;
+						ld->evaluatePair(view, i, j, candidates);
+					}
+				}
 			}
-			double d1 = dist_p2p(entire_v[0].p1, entire_v[1].p1);
-			if (d1 < 0.1)
+			else
 			{
+				int n_ij = ij->size();
+				for (int c = n_ij * s / n_stripes; c < n_ij * (s + 1) / n_stripes; c++)
+				{
+					int i = (*ij)[c].x, j = (*ij)[c].y;
+					if (view.z1[i] < 0)
+						continue;
+					ld->evaluatePair(view, i, j, candidates);
+				}
+			}
+		}
+	}
+
+private:
+	LaneDetection *ld;
+	const SegmentTable &view;
+	const vector<Point> *ij;
+	int n_stripes;
+	vector<vector<LaneDetection::PairCandidate> > &stripe_candidates;
+};
+
+void LaneDetection::evaluatePairs(const SegmentTable &view, const vector<Point> *ij, vector<PairCandidate> &candidates)
+{
+	candidates.clear();
+	int n_items = ij == NULL ? view.size() : (int)ij->size();
+	if (n_items == 0)
+		return;
+
+	int n_threads = pairThreads > 0 ? pairThreads : getNumThreads();
 #ifdef DEBUG_FOUT
-				fout_2 << "d1 < 0.1  " << endl;
-				fout_2 << i << "," << j << "[" << p12_img->p1 << "," << p12_img->p2 << "] and [" << seg_img->p1 << "," << seg_img->p2 << endl;
+	n_threads = 1;//one log
 #endif
-				continue;
-			}
+	//a few stripes per thread, the rows don't cost the same
+	int n_stripes = n_threads > 1 ? min(n_items, n_threads * 4) : 1;
 
-			//color compare
-			Point2d translation[3];
-			translation[0] = Point2d(0, 0);
-			translation[1] = entire_v[0].p1 - entire_v[1].p1;
-			translation[2] = -translation[1];
-			if (translation[1].x > 0)
-			{
-				translation[2] = entire_v[0].p1 - entire_v[1].p1;
-				translation[1] = -translation[2];
-			}
+	vector<vector<PairCandidate> > stripe_candidates(n_stripes);
+	EvaluatePairsBody body(this, view, ij, n_stripes, stripe_candidates);
+	if (n_stripes > 1)
+		parallel_for_(Range(0, n_stripes), body, n_stripes);
+	else
+		body(Range(0, 1));
 
-			//translation[1] -= Point2d(0.1, 0);
-			//translation[2] += Point2d(0.1, 0);
+	for (int s = 0; s < n_stripes; s++)
+		candidates.insert(candidates.end(), stripe_candidates[s].begin(), stripe_candidates[s].end());
+}
 
-			vector<Vec3b> vec_color[3];
-			Vec3d mean_color[3];
+void LaneDetection::mergePairs(vector<PairCandidate> &candidates, const SegmentTable &view,
+	const Mat &maskRoad, vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_image)
+{
+	pairs.clear();
+	pairs_in_image.clear();
 
+	int num_sample = 10;
+	int n_segments = view.size();
+	int **pair_relation = new int*[n_segments];//index of pair of ith segment and jth segment. If they are not, it's -1.
+	for (int i = 0; i < n_segments; i++)
+	{
+		pair_relation[i] = new int[n_segments];
+		for (int j = 0; j < n_segments; j++)
+		{
+			pair_relation[i][j] = -1;
+		}
+	}
 
-			Point2d src_p[4];
-			for (int i = 0; i < 2; i++)
-			{
-				for (int j = 0; j < 2; j++)
-				{
-					j == 0 ? src_p[i * 2 + j] = entire_v[i].p1 : src_p[i * 2 + j] = entire_v[i].p2;
-				}
-			}
+	//in the order of the candidates : a pair may replace an overlapping pair found before
+	for (int c = 0; c < (int)candidates.size(); c++)
+	{
+		int i = candidates[c].i;
+		int j = candidates[c].j;
+		Pair2d &pair2d = candidates[c].pair;
+		const Pair2d &pair2d_img = candidates[c].pair_img;
+		const Segment2d &p12_img = pair2d_img.s1;
+		const Segment2d &seg_img = pair2d_img.s2;
 
+//			if (times > 0)
+		{
+			bool b_check_overlay = true;
 
-			for (int _trans = 0; _trans < 3; _trans++)
+			//check overlap
+			for (int k = 0; k < n_segments; k++)
 			{
-				Point2d trans = translation[_trans];
-				//Point2d dst_p[4];
-				//for (int n = 0; n < 4; n++)
-				//{
-				//	ipm->convert_inv(src_p[n].x + trans.x, src_p[n].y + trans.y, dst_p[n].x, dst_p[n].y);
-				//}
-
-				Point2d center = (src_p[0] + src_p[1] + src_p[2] + src_p[3]) / 4;
-				Point2d _p_dst;
-				ipm->convert_inv(center.x + trans.x, center.y + trans.y, _p_dst.x, _p_dst.y);
-				if (_p_dst.y < 0 || _p_dst.y > rawColorImage.rows - 1)
+				int index = pair_relation[i][k];
+				if (index < 0)
 					continue;
-				if (_p_dst.x < 0 || _p_dst.x > rawColorImage.cols - 1)
+
+				double y1 = pairs[index]._p12.p1.y;//p1.y < p2.y
+				double y2 = pairs[index]._p12.p2.y;
+				double mean_color = pairs[index].mean_color;
+				double mean_width = pairs[index].mean_width;
+
+				if (pair2d._p12.p1.y > y2 || pair2d._p12.p2.y < y1)
+					continue;
+
+				if (pair2d.mean_width / mean_width < 1.8 && pair2d.mean_width / mean_width > 0.56)
 					continue;
-				vec_color[_trans].push_back(rawColorImage.at<Vec3b>(_p_dst.y, _p_dst.x));
 
-				for (int n = 0; n < 4; n++)
+				double arry[4] = { pair2d._p12.p1.y, pair2d._p12.p2.y, y1, y2 };
+				for (int i = 1, j = 0; i < 4; i++)
 				{
-					Point2d _p_sample = (center + src_p[n]) / 2 + trans;
-					ipm->convert_inv(_p_sample.x, _p_sample.y, _p_dst.x, _p_dst.y);
-					if (_p_dst.y < 0 || _p_dst.y > rawColorImage.rows - 1)
-						continue;
-					if (_p_dst.x < 0 || _p_dst.x > rawColorImage.cols - 1)
-						continue;
-					vec_color[_trans].push_back(rawColorImage.at<Vec3b>(_p_dst.y, _p_dst.x));
+					double temp = arry[i];
+					for (j = i - 1; j >= 0 && temp <= arry[j]; j--)
+					{
+						arry[j + 1] = arry[j];
+					}
+					arry[j + 1] = temp;
 				}
 
-				//for (int cen_x_i = -1; cen_x_i < 2; cen_x_i++)
-				//{
-				//	for (int cen_y_i = -1; cen_y_i < 2; cen_y_i++)
-				//	{
-				//		if (cen_y + cen_y_i < 0 || cen_y + cen_y_i > rawColorImage.rows - 1)
-				//			continue;
-				//		if (cen_x + cen_x_i < 0 || cen_x + cen_x_i > rawColorImage.cols - 1)
-				//			continue;
-				//		vec_color[_trans].push_back(rawColorImage.at<Vec3b>(cen_y + cen_y_i, cen_x + cen_x_i));
-				//	}
-				//}
-				
-
-				//Rect box = getBoundingBox_d(dst_p[0], dst_p[1],
-				//	dst_p[2], dst_p[3]);
-
-				//for (int _y = box.y; _y < box.y + box.height; _y++)
-				//{
-				//	if (_y >= rawGrayImage.rows || _y < 0) continue;
-				//	const Vec3b* ptr_row_processImage = rawColorImage.ptr<Vec3b>(_y);
-				//	for (int _x = box.x; _x < box.x + box.width; _x++)
-				//	{
-				//		if (_x >= rawGrayImage.cols || _x < 0) continue;
-				//		Point2d p(_x, _y);
-
-				//		int direc = (p - dst_p[0]).cross(p - dst_p[1]) > -0.0 ? 1 : -1;
-
-				//		if (direc != ((p - dst_p[1]).cross(p - dst_p[3]) > -0.0 ? 1 : -1))
-				//			continue;
-				//		if (direc != ((p - dst_p[3]).cross(p - dst_p[2]) > -0.0 ? 1 : -1))
-				//			continue;
-				//		if (direc != ((p - dst_p[2]).cross(p - dst_p[0]) > -0.0 ? 1 : -1))
-				//			continue;
-
-				//		vec_color[_trans].push_back(ptr_row_processImage[_x]);
-				//	}
-				//}
-
-
-				if (vec_color[_trans].empty())
+				double overlap_y = arry[2] - arry[1];
+				if (overlap_y / pair2d._p12.getLength() < 0.2
+					&& overlap_y / (y2 - y1) < 0.2)
+					continue;
+
+				if (pair2d.mean_color > mean_color)
 				{
-					//cout << "empty" << ", ";
+					pairs[index] = pair2d;
+					pairs_in_image[index] = pair2d_img;
+					pair_relation[i][k] = -1;
+					pair_relation[k][i] = -1;
+					pair_relation[i][j] = index;
+					pair_relation[j][i] = index;
 				}
 				else
 				{
-					Mat mean, stdDev;
-					meanStdDev(vec_color[_trans], mean, stdDev);
-					mean_color[_trans] = Vec3d(mean.at<double>(0), mean.at<double>(1), mean.at<double>(2));
-
-					//line(pairImage, dst_p[0], dst_p[1], Scalar(255, 0, 0));
-					//line(pairImage, dst_p[1], dst_p[3], Scalar(255, 255, 0));
-					//line(pairImage, dst_p[2], dst_p[3], Scalar(255, 0, 0));
-					//line(pairImage, dst_p[2], dst_p[0], Scalar(255, 255, 0));
-
-					//cout << mean_color[_trans] << ",";
+					b_check_overlay = false;
 				}
-				
-			}
-			//cout << endl;
-
-			double g[3];//mean gray color in three rectangles
-			for (int g_n = 0; g_n < 3; g_n++)
-			{
-				g[g_n] = 0.114*mean_color[g_n][0] + 0.587*mean_color[g_n][1] + 0.299*mean_color[g_n][2];
-			}
-			bool color_matched = g[0] > g[1] + 10 && g[0] > g[2] + 10;
-			//for (int g_n = 0; g_n < 3; g_n++)
-			//{
-			//	color_matched = color_matched &&
-			//		mean_color[0][g_n] > mean_color[1][g_n] + 10
-			//		&& mean_color[0][g_n] > mean_color[2][g_n] + 10;
-			//}
-
-			//color_matched = color_matched && abs(mean_color[0][0] - mean_color[0][1]) < 50
-			//	&& abs(mean_color[0][0] - mean_color[0][2]) < 50;
-
-			//bool color_matched = (g[0] > g[1] + 10) && (g[0] > g[2] + 10);
-			if (!color_matched)
-			{
-				//fout_2 << p1 << p2 << seg1 << seg2 << mean_color[0] << "," << mean_color[1] << "," << mean_color[2];
-				//fout_2 << "," << stdDev_color[0] << endl;
-				//fout_2 << "continue in color_matched" << endl;
-#ifdef DEBUG_FOUT
-				fout_2 << "!color_matched  " << endl;
-				fout_2 << i << "," << j << "[" << p12_img->p1 << "," << p12_img->p2 << "] and [" << seg_img->p1 << "," << seg_img->p2 << endl;
-#endif
-				continue;
 			}
 
-			Pair2d pair2d(*p12, *seg, entire_v[0].p1, entire_v[0].p2, entire_v[1].p1, entire_v[1].p2);
-			Pair2d pair2d_img(*p12_img, *seg_img);
-			double mean_width = d1;
-			pair2d.setMeanWidth(mean_width);
-			pair2d.setMeanColor(g[0]);
-			pair2d.computeLineModel();
-
-//			if (times > 0)
+			for (int k = 0; k < n_segments; k++)
 			{
-				bool b_check_overlay = true;
-
-				//check overlap
-				for (int k = 0; k < n_segments; k++)
-				{
-					int index = pair_relation[i][k];
-					if (index < 0)
-						continue;
+				int index = pair_relation[j][k];
+				if (index < 0)
+					continue;
 
-					double y1 = pairs[index]._p12.p1.y;//p1.y < p2.y
-					double y2 = pairs[index]._p12.p2.y;
-					double mean_color = pairs[index].mean_color;
-					double mean_width = pairs[index].mean_width;
+				double y1 = pairs[index]._p12.p1.y;//p1.y < p2.y
+				double y2 = pairs[index]._p12.p2.y;
+				double mean_color = pairs[index].mean_color;
+				double mean_width = pairs[index].mean_width;
 
-					if (pair2d._p12.p1.y > y2 || pair2d._p12.p2.y < y1)
-						continue;
+				if (pair2d._p12.p1.y > y2 || pair2d._p12.p2.y < y1)
+					continue;
 
-					if (pair2d.mean_width / mean_width < 1.8 && pair2d.mean_width / mean_width > 0.56)
-						continue;
+				if (pair2d.mean_width / mean_width < 1.8 && pair2d.mean_width / mean_width > 0.56)
+					continue;
 
-					double arry[4] = { pair2d._p12.p1.y, pair2d._p12.p2.y, y1, y2 };
-					for (int i = 1, j = 0; i < 4; i++)
+				double arry[4] = { pair2d._p12.p1.y, pair2d._p12.p2.y, y1, y2 };
+				for (int i = 1, j = 0; i < 4; i++)
+				{
+					double temp = arry[i];
+					for (j = i - 1; j >= 0 && temp <= arry[j]; j--)
 					{
-						double temp = arry[i];
-						for (j = i - 1; j >= 0 && temp <= arry[j]; j--)
-						{
-							arry[j + 1] = arry[j];
-						}
-						arry[j + 1] = temp;
+						arry[j + 1] = arry[j];
 					}
+					arry[j + 1] = temp;
+				}
 
-					double overlap_y = arry[2] - arry[1];
-					if (overlap_y / pair2d._p12.getLength() < 0.2
-						&& overlap_y / (y2 - y1) < 0.2)
-						continue;
+				double overlap_y = arry[2] - arry[1];
+				if (overlap_y / pair2d._p12.getLength() < 0.2
+					&& overlap_y / (y2 - y1) < 0.2)
+					continue;
 
-					if (pair2d.mean_color > mean_color)
-					{
-						pairs[index] = pair2d;
-						pairs_in_image[index] = pair2d_img;
-						pair_relation[i][k] = -1;
-						pair_relation[k][i] = -1;
-						pair_relation[i][j] = index;
-						pair_relation[j][i] = index;
-					}
-					else
-					{
-						b_check_overlay = false;
-					}
+				if (pair2d.mean_color > mean_color)
+				{
+					pairs[index] = pair2d;
+					pairs_in_image[index] = pair2d_img;
+					pair_relation[i][k] = -1;
+					pair_relation[k][i] = -1;
+					pair_relation[i][j] = index;
+					pair_relation[j][i] = index;
 				}
-
-				for (int k = 0; k < n_segments; k++)
+				else
 				{
-					int index = pair_relation[j][k];
-					if (index < 0)
-						continue;
-
-					double y1 = pairs[index]._p12.p1.y;//p1.y < p2.y
-					double y2 = pairs[index]._p12.p2.y;
-					double mean_color = pairs[index].mean_color;
-					double mean_width = pairs[index].mean_width;
-
-					if (pair2d._p12.p1.y > y2 || pair2d._p12.p2.y < y1)
-						continue;
-
-					if (pair2d.mean_width / mean_width < 1.8 && pair2d.mean_width / mean_width > 0.56)
-						continue;
-
-					double arry[4] = { pair2d._p12.p1.y, pair2d._p12.p2.y, y1, y2 };
-					for (int i = 1, j = 0; i < 4; i++)
-					{
-						double temp = arry[i];
-						for (j = i - 1; j >= 0 && temp <= arry[j]; j--)
-						{
-							arry[j + 1] = arry[j];
-						}
-						arry[j + 1] = temp;
-					}
-
-					double overlap_y = arry[2] - arry[1];
-					if (overlap_y / pair2d._p12.getLength() < 0.2
-						&& overlap_y / (y2 - y1) < 0.2)
-						continue;
-
-					if (pair2d.mean_color > mean_color)
-					{
-						pairs[index] = pair2d;
-						pairs_in_image[index] = pair2d_img;
-						pair_relation[i][k] = -1;
-						pair_relation[k][i] = -1;
-						pair_relation[i][j] = index;
-						pair_relation[j][i] = index;
-					}
-					else
-					{
-						b_check_overlay = false;
-					}
+					b_check_overlay = false;
 				}
+			}
 
-				if (!b_check_overlay)
-				{
+			if (!b_check_overlay)
+			{
 #ifdef DEBUG_FOUT
-					fout_2 << "!b_check_overlay  " << endl;
-					fout_2 << i << "," << j << "[" << p12_img->p1 << "," << p12_img->p2 << "] and [" << seg_img->p1 << "," << seg_img->p2 << endl;
+				fout_2 << "!b_check_overlay  " << endl;
+				fout_2 << i << "," << j << "[" << p12_img.p1 << "," << p12_img.p2 << "] and [" << seg_img.p1 << "," << seg_img.p2 << endl;
 #endif
-					continue;
-				}
-
+				continue;
 			}
 
+		}
+
 
-			p12_img;
-			seg_img;
-			bool b_mask = false;
-			if (maskRoad.data)
+		p12_img;
+		seg_img;
+		bool b_mask = false;
+		if (maskRoad.data)
+		{
+			double u = p12_img.p1.x;
+			double v = p12_img.p1.y;
+			double u2 = p12_img.p2.x;
+			double v2 = p12_img.p2.y;
+			for (int i_sample = 0; i_sample < num_sample; i_sample++)
 			{
-				imshow("mask", maskRoad);
-				double u = p12_img->p1.x;
-				double v = p12_img->p1.y;
-				double u2 = p12_img->p2.x;
-				double v2 = p12_img->p2.y;
-				for (int i_sample = 0; i_sample < num_sample; i_sample++)
+				int u_s = i_sample * (u - u2) / num_sample + u2;
+				int v_s = i_sample * (v - v2) / num_sample + v2;
+				if (u_s <= 0) u_s = 1;
+				if (u_s >= rawColorImage.cols - 1) u_s = rawColorImage.cols - 2;
+				if (v_s <= 0) v_s = 1;
+				if (v_s >= rawColorImage.rows - 1) v_s = rawColorImage.rows - 2;
+
+				const uchar* ptr_maskRoad = maskRoad.ptr<uchar>(v_s - 1);
+				const uchar* ptr_maskRoad_2 = maskRoad.ptr<uchar>(v_s);
+				const uchar* ptr_maskRoad_3 = maskRoad.ptr<uchar>(v_s + 1);
+
+				for (int c_sample = -1; c_sample < 2; c_sample++)
 				{
-					int u_s = i_sample * (u - u2) / num_sample + u2;
-					int v_s = i_sample * (v - v2) / num_sample + v2;
-					if (u_s <= 0) u_s = 1;
-					if (u_s >= rawColorImage.cols - 1) u_s = rawColorImage.cols - 2;
-					if (v_s <= 0) v_s = 1;
-					if (v_s >= rawColorImage.rows - 1) v_s = rawColorImage.rows - 2;
-
-					const uchar* ptr_maskRoad = maskRoad.ptr<uchar>(v_s - 1);
-					const uchar* ptr_maskRoad_2 = maskRoad.ptr<uchar>(v_s);
-					const uchar* ptr_maskRoad_3 = maskRoad.ptr<uchar>(v_s + 1);
-
-					for (int c_sample = -1; c_sample < 2; c_sample++)
+					if (ptr_maskRoad[c_sample + u_s] > 10
+						|| ptr_maskRoad_2[c_sample + u_s] > 10
+						|| ptr_maskRoad_3[c_sample + u_s] > 10)
 					{
-						if (ptr_maskRoad[c_sample + u_s] > 10
-							|| ptr_maskRoad_2[c_sample + u_s] > 10
-							|| ptr_maskRoad_3[c_sample + u_s] > 10)
-						{
-							b_mask = true;
-							break;
-						}
-					}
-
-					if (b_mask)
+						b_mask = true;
 						break;
+					}
 				}
 
-				u = seg_img->p1.x;
-				v = seg_img->p1.y;
-				u2 = seg_img->p2.x;
-				v2 = seg_img->p2.y;
-				for (int i_sample = 0; i_sample < num_sample; i_sample++)
+				if (b_mask)
+					break;
+			}
+
+			u = seg_img.p1.x;
+			v = seg_img.p1.y;
+			u2 = seg_img.p2.x;
+			v2 = seg_img.p2.y;
+			for (int i_sample = 0; i_sample < num_sample; i_sample++)
+			{
+				int u_s = i_sample * (u - u2) / num_sample + u2;
+				int v_s = i_sample * (v - v2) / num_sample + v2;
+				if (u_s <= 0) u_s = 1;
+				if (u_s >= rawColorImage.cols - 1) u_s = rawColorImage.cols - 2;
+				if (v_s <= 0) v_s = 1;
+				if (v_s >= rawColorImage.rows - 1) v_s = rawColorImage.rows - 2;
+
+				const uchar* ptr_maskRoad = maskRoad.ptr<uchar>(v_s - 1);
+				const uchar* ptr_maskRoad_2 = maskRoad.ptr<uchar>(v_s);
+				const uchar* ptr_maskRoad_3 = maskRoad.ptr<uchar>(v_s + 1);
+
+				for (int c_sample = -1; c_sample < 2; c_sample++)
 				{
-					int u_s = i_sample * (u - u2) / num_sample + u2;
-					int v_s = i_sample * (v - v2) / num_sample + v2;
-					if (u_s <= 0) u_s = 1;
-					if (u_s >= rawColorImage.cols - 1) u_s = rawColorImage.cols - 2;
-					if (v_s <= 0) v_s = 1;
-					if (v_s >= rawColorImage.rows - 1) v_s = rawColorImage.rows - 2;
-
-					const uchar* ptr_maskRoad = maskRoad.ptr<uchar>(v_s - 1);
-					const uchar* ptr_maskRoad_2 = maskRoad.ptr<uchar>(v_s);
-					const uchar* ptr_maskRoad_3 = maskRoad.ptr<uchar>(v_s + 1);
-
-					for (int c_sample = -1; c_sample < 2; c_sample++)
+					if (ptr_maskRoad[c_sample + u_s] > 10
+						|| ptr_maskRoad_2[c_sample + u_s] > 10
+						|| ptr_maskRoad_3[c_sample + u_s] > 10)
 					{
-						if (ptr_maskRoad[c_sample + u_s] > 10
-							|| ptr_maskRoad_2[c_sample + u_s] > 10
-							|| ptr_maskRoad_3[c_sample + u_s] > 10)
-						{
-							b_mask = true;
-							break;
-						}
-					}
-
-					if (b_mask)
+						b_mask = true;
 						break;
+					}
 				}
 
+				if (b_mask)
+					break;
 			}
-			else
-				b_mask = true;
 
-			if (!b_mask)
-			{
-				continue;
-			}
+		}
+		else
+			b_mask = true;
 
-			//double angle = atan(pair2d._p12.getSlope());
-			//if (angle < 0) angle += CV_PI;
-			//slopes.push_back(angle);
+		if (!b_mask)
+		{
+			continue;
+		}
+
+		//double angle = atan(pair2d._p12.getSlope());
+		//if (angle < 0) angle += CV_PI;
+		//slopes.push_back(angle);
 
 #ifdef DEBUG_FOUT
-			fout_2 << "pairs_in_image.push_back(pair2d_img) " << endl;
-			fout_2 << i << "," << j << "[" << p12_img->p1 << "," << p12_img->p2 << "] and [" << seg_img->p1 << "," << seg_img->p2 << endl;
+		fout_2 << "pairs_in_image.push_back(pair2d_img) " << endl;
+		fout_2 << i << "," << j << "[" << p12_img.p1 << "," << p12_img.p2 << "] and [" << seg_img.p1 << "," << seg_img.p2 << endl;
 #endif
-			
-			pairs.push_back(pair2d);
-			pairs_in_image.push_back(pair2d_img);
+		
+		pairs.push_back(pair2d);
+		pairs_in_image.push_back(pair2d_img);
 
-			pair_relation[i][j] = pairs.size() - 1;
-			pair_relation[j][i] = pairs.size() - 1;
-			
-		}
+		pair_relation[i][j] = pairs.size() - 1;
+		pair_relation[j][i] = pairs.size() - 1;
 	}
 
 	for (int i = 0 ; i < n_segments; i++)
@@ -1518,6 +1701,28 @@ void LaneDetection::findPairs(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_im
 		delete pair_relation[i];
 	}
 	delete pair_relation;
+}
+
+void LaneDetection::findPairs(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_image, const Mat &maskRoad, int times)
+{
+	SegmentTable view;
+	projectSegments(view);
+	pairCache.lsd_index = view.lsd;
+
+	vector<double> slopes;
+	
+
+	//step 3 : find pairs
+	vector<PairCandidate> candidates;
+	evaluatePairs(view, NULL, candidates);
+	mergePairs(candidates, view, maskRoad, pairs, pairs_in_image);
+
+	pairCache.candidates.clear();
+	for (int c = 0; c < (int)candidates.size(); c++)
+		pairCache.candidates.push_back(Point(pairCache.lsd_index[candidates[c].i], pairCache.lsd_index[candidates[c].j]));
+	double h;
+	ipm->getRxAndH(pairCache.rx, h);
+	pairCache.valid = true;
 
 	////mean shift to find slope center
 	//vector<Pair2d> _pairs_copy = pairs;
@@ -1559,6 +1764,63 @@ void LaneDetection::findPairs(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_im
 	//}
 }
 
+void LaneDetection::findPairsAgain(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_image, const Mat &maskRoad)
+{
+	double rx, h;
+	ipm->getRxAndH(rx, h);
+	if (!pairCache.valid || abs(rx - pairCache.rx) > pairCache.max_rx_delta)
+	{
+		findPairs(pairs, pairs_in_image, maskRoad, 2);
+		return;
+	}
+
+	//position of the lsd segments in the in-view segments, before and after the pitch change
+	int n_lsd = lsdSegments.size();
+	vector<int> index_before(n_lsd, -1), index(n_lsd, -1);
+	for (int k = 0; k < (int)pairCache.lsd_index.size(); k++)
+		index_before[pairCache.lsd_index[k]] = k;
+
+	SegmentTable view;
+	projectSegments(view);
+	pairCache.lsd_index = view.lsd;
+	int n_segments = view.size();
+	for (int k = 0; k < n_segments; k++)
+		index[pairCache.lsd_index[k]] = k;
+
+	//candidates of the first pass whose segments are still in view
+	vector<Point> ij;
+	for (int c = 0; c < (int)pairCache.candidates.size(); c++)
+	{
+		int i = index[pairCache.candidates[c].x];
+		int j = index[pairCache.candidates[c].y];
+		if (i >= 0 && j >= 0)
+			ij.push_back(Point(i, j));
+	}
+	//all the pairs of the segments which entered the view
+	vector<bool> entered(n_segments);
+	for (int k = 0; k < n_segments; k++)
+		entered[k] = index_before[pairCache.lsd_index[k]] < 0;
+	for (int i = 0; i < n_segments; i++)
+	{
+		for (int j = 0; j < n_segments; j++)
+		{
+			if (j != i && (entered[i] || entered[j]))
+				ij.push_back(Point(i, j));
+		}
+	}
+	//same order as the full search, so that the overlaps are resolved the same way
+	sort(ij.begin(), ij.end(), [](const Point &a, const Point &b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+	vector<PairCandidate> candidates;
+	evaluatePairs(view, &ij, candidates);
+	mergePairs(candidates, view, maskRoad, pairs, pairs_in_image);
+
+	pairCache.candidates.clear();
+	for (int c = 0; c < (int)candidates.size(); c++)
+		pairCache.candidates.push_back(Point(pairCache.lsd_index[candidates[c].i], pairCache.lsd_index[candidates[c].j]));
+	pairCache.rx = rx;
+}
+
 void LaneDetection::checkPairs(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_image)
 {
 	if (pairs.size() != pairs_in_image.size())
@@ -1581,7 +1843,7 @@ void LaneDetection::checkPairs(vector<Pair2d> &pairs, vector<Pair2d> &pairs_in_i
 
 }
 
-vector< vector<Pair2d> > LaneDetection::method3(const Mat &img, int winFlag, const Mat &maskRoad)
+vector< vector<Pair2d> > LaneDetection::method3(const Mat &img, int winFlag, const Mat &maskRoad, const Mat &gray)
 {
 #ifdef DEBUG_FOUT
 	fout_2.open("debug_fout.txt");
@@ -1598,7 +1860,10 @@ vector< vector<Pair2d> > LaneDetection::method3(const Mat &img, int winFlag, con
 	img.copyTo(rawImage);
 	if (rawImage.channels() == 3)
 	{
-		cvtColor(rawImage, rawGrayImage, CV_BGR2GRAY);
+		if (gray.size() == rawImage.size() && gray.type() == CV_8UC1)
+			gray.copyTo(rawGrayImage);
+		else
+			cvtColor(rawImage, rawGrayImage, CV_BGR2GRAY);
 		rawColorImage = rawImage;
 	}
 	else if (rawImage.channels() == 1)
@@ -1613,6 +1878,7 @@ vector< vector<Pair2d> > LaneDetection::method3(const Mat &img, int winFlag, con
 		return pairs_;
 	}
 
+	startTracking();
 	resultLSD();
 
 	//Mat maskRoad;
@@ -1621,15 +1887,28 @@ vector< vector<Pair2d> > LaneDetection::method3(const Mat &img, int winFlag, con
 	//imshow("maskRoad", maskRoad);
 
 
-	findPairs(pairs, pairs_in_image, maskRoad);
-	//double rx, h;
-	//ipm->getRxAndH(rx, h);
-	//cout << "1 "<< rx << "," << h << endl;
-	updateIPM2(pairs_in_image);
-	cout << "----------------------------------" << endl;
-	//ipm->getRxAndH(rx, h);
-	//cout << "2 "<<  rx << "," << h << endl;
-	findPairs(pairs, pairs_in_image, maskRoad, 2);
+	if (updateIPMFromGroundPlane())
+		findPairs(pairs, pairs_in_image, maskRoad);
+	else if (updateIPMFromOdometry())
+	{
+		findPairs(pairs, pairs_in_image, maskRoad, 2);
+		if (frameCount % ekfInterval == 0)
+			updateIPM2(pairs_in_image);//drift correction, used from the next frame
+	}
+	else
+	{
+		findPairs(pairs, pairs_in_image, maskRoad);
+		//double rx, h;
+		//ipm->getRxAndH(rx, h);
+		//cout << "1 "<< rx << "," << h << endl;
+		updateIPM2(pairs_in_image);
+		cout << "----------------------------------" << endl;
+		//ipm->getRxAndH(rx, h);
+		//cout << "2 "<<  rx << "," << h << endl;
+		findPairsAgain(pairs, pairs_in_image, maskRoad);
+	}
+	updateTracking(pairs);
+	frameCount++;
 
 
 	
@@ -1728,23 +2007,27 @@ vector< vector<Pair2d> > LaneDetection::method3(const Mat &img, int winFlag, con
 }
 
 
-vector<Pair2d> LaneDetection::method4(const Mat &rL, const Mat &disp, int winFlag)
+vector< vector<Pair2d> > LaneDetection::method4(const Mat &rL, const Mat &disp, int winFlag, const Mat &gray)
 {
 #ifdef DEBUG_FOUT
 	fout_2.open("debug_fout.txt");
 #endif
 	vector<Pair2d> pairs;
 	vector<Pair2d> pairs_in_image;
+	vector< vector<Pair2d> > pairs_;
 	if (ipm == NULL)
 	{
 		cout << "ipm is null .. " << endl;
-		return pairs;
+		return pairs_;
 	}
 
 	rL.copyTo(rawImage);
 	if (rawImage.channels() == 3)
 	{
-		cvtColor(rawImage, rawGrayImage, CV_BGR2GRAY);
+		if (gray.size() == rawImage.size() && gray.type() == CV_8UC1)
+			gray.copyTo(rawGrayImage);
+		else
+			cvtColor(rawImage, rawGrayImage, CV_BGR2GRAY);
 		rawColorImage = rawImage;
 	}
 	else if (rawImage.channels() == 1)
@@ -1756,9 +2039,10 @@ vector<Pair2d> LaneDetection::method4(const Mat &rL, const Mat &disp, int winFla
 	if (!rawGrayImage.data)
 	{
 		cout << "processImage is empty. " << endl;
-		return pairs;
+		return pairs_;
 	}
 
+	startTracking();
 	resultLSD();
 
 	Mat maskRoad;
@@ -1770,14 +2054,25 @@ vector<Pair2d> LaneDetection::method4(const Mat &rL, const Mat &disp, int winFla
 	//imshow("maskRoad", maskRoad);
 
 
-	findPairs(pairs, pairs_in_image);
-	//double rx, h;
-	//ipm->getRxAndH(rx, h);
-	//cout << "1 "<< rx << "," << h << endl;
-	updateIPM2(pairs_in_image);
-	//ipm->getRxAndH(rx, h);
-	//cout << "2 "<<  rx << "," << h << endl;
-	findPairs(pairs, pairs_in_image);
+	if (updateIPMFromOdometry())
+	{
+		findPairs(pairs, pairs_in_image, maskRoad);
+		if (frameCount % ekfInterval == 0)
+			updateIPM2(pairs_in_image);//drift correction, used from the next frame
+	}
+	else
+	{
+		findPairs(pairs, pairs_in_image, maskRoad);
+		//double rx, h;
+		//ipm->getRxAndH(rx, h);
+		//cout << "1 "<< rx << "," << h << endl;
+		updateIPM2(pairs_in_image);
+		//ipm->getRxAndH(rx, h);
+		//cout << "2 "<<  rx << "," << h << endl;
+		findPairsAgain(pairs, pairs_in_image, maskRoad);
+	}
+	updateTracking(pairs);
+	frameCount++;
 
 #ifdef DEBUG_drawImage
 	Mat updateIPM_img;
@@ -1831,7 +2126,10 @@ vector<Pair2d> LaneDetection::method4(const Mat &rL, const Mat &disp, int winFla
 #ifdef DEBUG_FOUT
 	fout_2.close();
 #endif
-	return pairs;
+	pairs_.push_back(pairs);
+	pairs_.push_back(pairs_in_image);
+
+	return pairs_;
 }
 
 void LaneDetection::segmentationRoad(Mat &maskRoad)
@@ -1886,18 +2184,18 @@ void LaneDetection::segmentationRoad(Mat &maskRoad)
 }
 
 
-void drawRoad(const Mat &disp, double rho, double theta){
+void drawRoad(const Mat &disp, const GroundLine &road){
 	Mat drawDisp;
 	cvtColor(disp, drawDisp, CV_GRAY2BGR);
 
-	double a = -1 / tan(theta), b = rho / sin(theta);
-	for (int r = b + 0.5; r < disp.rows; r++)
+	for (int r = road.intercept + 0.5; r < disp.rows; r++)
 	{
+		if (r < 0) continue;
 		Vec3b* ptr_row_drawDisp = drawDisp.ptr<Vec3b>(r);
 		const uchar* ptr_row_disp = disp.ptr<uchar>(r);
 
 
-		double x = (r - b) / a;
+		double x = (r - road.intercept) / road.slope;
 		int x0 = x - 15, x1 = x + 15;
 		for (int c = 0; c < disp.cols; c++)
 		{
@@ -1911,174 +2209,43 @@ void drawRoad(const Mat &disp, double rho, double theta){
 
 	imshow("road", drawDisp);
 }
-const int intervalMax = 100, intervalMin = 10, step_ = 16;
-inline int betterVote(int nup, int u, int ndown, int d)
-{
-	return (int)(max(2.0, (double)(u - d)*(intervalMax - ndown) / (nup - ndown)) + d);
-}
-int g_better_vote = -1;
+
 void LaneDetection::roadExtraFromDisp(const Mat &disp, Mat &maskRoad)
 {
 	double fx, fy, cv, cu;
 	ipm->getCameraParam(fx, fy, cu, cv);
-	
-	//v-disp
-	Mat vdisp = Mat::zeros(disp.rows, 256, CV_8UC1);
-	for (int _r = disp.rows / 2; _r < disp.rows; _r++)
-	{
-		const uchar* ptr_row_disp = disp.ptr<uchar>(_r);
-		uchar* ptr_row_vdisp = vdisp.ptr<uchar>(_r);
 
-		for (int _c = 0; _c < disp.cols; _c++)
-		{
-			if (ptr_row_disp[_c] < 5) continue;
-			if (ptr_row_vdisp[ptr_row_disp[_c]] < 255)
-				ptr_row_vdisp[ptr_row_disp[_c]]++;
-		}
-	}
-	Mat raw_vdisp;
-	vdisp.copyTo(raw_vdisp);
-	imshow("v-disp-raw", vdisp);
+	//camera parameters in the resolution of disp (half resolution with elas subsampling)
+	double scale = (double)disp.rows / rawGrayImage.rows;
+	fx *= scale;
+	cv *= scale;
 
-	threshold(vdisp, vdisp, 0, 255, THRESH_OTSU);
-	vector<Vec2f> lines_0, lines_1;
-	imshow("v-disp-thre", vdisp);
-
-	if (g_better_vote < 0)
-	{
-		for (int i = 150; i > 15; i -= 10)
-		{
-			lines_0 = lines_1;
-			HoughLines(vdisp, lines_1, 1, 0.01 * CV_PI / 180, i, 0, 0, 120 * CV_PI / 180, 150 * CV_PI / 180);
-			int numOfLines = lines_1.size();
-			if (numOfLines > intervalMax)
-			{
-				g_better_vote = i + 10;
-				if (lines_0.size() == 0)
-				{
-					g_better_vote = i;
-				}
-				break;
-			}
-		}
-	}
-
-	int vote = g_better_vote;
-	int bi_down = max(0, g_better_vote - step_), bi_up = g_better_vote + step_;
-	int numOfLines_down = -1, numOfLines_up = -1;
-
-	bool DownUpKnown = false;
-	for (int times_i = 0; times_i < 5; times_i++)
-	{
-
-		HoughLines(vdisp, lines_1, 1, 0.01 * CV_PI / 180, vote, 0, 0, 120 * CV_PI / 180, 150 * CV_PI / 180);
-
-		//cout << "-----------------------in loop------------------------" << endl;
-		//cout << DownUpKnown << endl;
-		//cout << "numOfLines_down: " << numOfLines_down << "," << "numOfLines_up : " << numOfLines_up << endl;
-		//cout << "down : " << bi_down << " : up " << bi_up << endl << " vote:" << vote << endl;
-		//cout << "lines_1.size() : " << lines_1.size() << endl;
-		//cout << "-----------------------end in loop--------------------" << endl;
-
-		int numOfLines = lines_1.size();
-		if (numOfLines <= intervalMax && numOfLines >= intervalMin)//perfect case
-		{
-			break;
-		}
-		else
-		{
-			if (DownUpKnown)
-			{
-				if (numOfLines < intervalMin)
-				{
-					bi_up = vote;
-					numOfLines_up = numOfLines;
-					vote = betterVote(numOfLines_up, bi_up, numOfLines_down, bi_down);
-				}
-				else
-				{
-					bi_down = vote;
-					numOfLines_down = numOfLines;
-					vote = betterVote(numOfLines_up, bi_up, numOfLines_down, bi_down);
-				}
-			}
-			else
-			{
-				if (numOfLines < intervalMin)
-				{
-					int n = numOfLines;
-					while (n < intervalMin)
-					{
-						vote = bi_down;
-						if (vote == 0)
-							break;
-						bi_down = max(0, vote - step_);
-						numOfLines_up = n;
-						HoughLines(vdisp, lines_1, 1, 0.01 * CV_PI / 180, vote, 0, 0, 120 * CV_PI / 180, 150 * CV_PI / 180);
-						n = lines_1.size();
-					}
-					if (n <= intervalMax)
-						break;
-
-					bi_down = vote;
-					numOfLines_down = n;
-					bi_up = vote + step_;
-					vote = betterVote(numOfLines_up, bi_up, numOfLines_down, bi_down);
-				}
-				else
-				{
-					int n = numOfLines;
-					while (n > intervalMax)
-					{
-						vote = bi_up;
-						bi_up = vote + step_;
-						numOfLines_down = n;
-						HoughLines(vdisp, lines_1, 1, 0.01 * CV_PI / 180, vote, 0, 0, 120 * CV_PI / 180, 150 * CV_PI / 180);
-						n = lines_1.size();
-					}
-					if (n >= intervalMin)
-						break;
-
-					bi_up = vote;
-					numOfLines_up = n;
-					bi_down = max(0, vote - step_);
-					vote = betterVote(numOfLines_up, bi_up, numOfLines_down, bi_down);
-				}
-				DownUpKnown = true;
-			}
-		}
-	}
-
-	vector<Vec2f> lines = lines_1;
-	g_better_vote = vote;
-	if (lines.size() == 0)
+	//v-disp and u-disp (16 bits) in one pass, road line without HoughLines
+	GroundLine road;
+	if (!groundLineEstimator.estimateFromDisparity(disp, cv, fx, road, disparityHistogram,
+		DisparityHistogram::V_DISPARITY | DisparityHistogram::U_DISPARITY))
 	{
 		cout << "--------------------------" << endl;
-		cout << "error! no lines detected! " << endl;
+		cout << "error! no road line detected! " << endl;
 		cout << "--------------------------" << endl;
+		return;
 	}
 
-	cvtColor(vdisp, vdisp, CV_GRAY2BGR);
-	double vanishing_point_y = 0;
-	double mean_rho = 0, mean_theta = 0;// y = -(cos(theta)/sin(theta))x + rho / sin(theta).
-	for (int i = 0; i < lines.size(); i++)
-	{
-		mean_rho += lines[i][0], mean_theta += lines[i][1];
-
-		line(vdisp, Point(vdisp.cols, lines[i][0] / sin(lines[i][1]) - (vdisp.cols - 1)*cos(lines[i][1]) / sin(lines[i][1])),
-			Point(0, lines[i][0] / sin(lines[i][1])), Scalar(255, 128, 0));
-	}
-	mean_rho /= lines.size();
-	mean_theta /= lines.size();
-	vanishing_point_y = cv - mean_rho / sin(mean_theta);
+	//road pixels in the resolution of disp, then edge-aware upsampling to the image
+	Mat maskRoadDisp;
+	roadMaskExtractor.extract(disp, road, disparityHistogram.udisp, maskRoadDisp);
+	roadMaskExtractor.upsample(maskRoadDisp, rawGrayImage, maskRoad);
 
-	double theta = atan2(vanishing_point_y, fx);
+#ifdef DEBUG_drawImage
+	Mat drawVDisp;
+	GroundLineEstimator::drawVDisparity(disparityHistogram.vdisp, road, drawVDisp);
+	imshow("v-disp", drawVDisp);
 
-	imshow("v-disp", vdisp);
-	//imwrite("2.png", vdisp);
-	//waitKey();
+	Mat drawUDisp;
+	normalize(disparityHistogram.udisp, drawUDisp, 0, 255, NORM_MINMAX, CV_8U);
+	imshow("u-disp", drawUDisp);
 
-	drawRoad(disp, mean_rho, mean_theta);
+	drawRoad(disp, road);
+	imshow("maskRoad", maskRoad);
+#endif
 }
-
-
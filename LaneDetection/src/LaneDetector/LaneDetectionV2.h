@@ -6,27 +6,30 @@ using namespace cv;
 #include "../LSD1.5/lsd.h"
 #include "../ConverterCoordinates/CC.h"
 #include "EKF.h"
+#include "../VDisparity/GroundLineEstimator.h"
+#include "../VDisparity/RoadMaskExtractor.h"
+#include "LaneTracker.h"
+#include "GroundSampler.h"
+#include "SegmentTable.h"
 
 
 #define half_pi CV_PI / 2
 
+class AsyncProcessVISO;
+
 class Segment2d // p1.y < p2.y
 {
 public:
 	Point2d p1;
 	Point2d p2;
 	int indexZone[4];//0 : y of small; 1 : y of big; 2 : x of small; 3 : x of big (of p1 and p2)
-	Segment2d() {};
+	Segment2d();
 	Segment2d(Point2d _p1, Point2d _p2, int scale = 3);
+	//slope and length already known (SegmentTable), for the ends in order
+	Segment2d(Point2d _p1, Point2d _p2, double _slope, double _length, int scale = 3);
 
-	double getSlope() {
-		if (!_ini_slope) computeSlope();
-		return slope;
-	}
-	double getLength() {
-		if (!_ini_length) computeLength();
-		return length;
-	}
+	double getSlope() const { return slope; }
+	double getLength() const { return length; }
 
 	double computeDistance(Point2d p);
 
@@ -43,12 +46,9 @@ public:
 	std::vector<Segment2d> getValidRect(Segment2d s);
 
 private:
-	bool _ini_slope;
-	bool _ini_length;
 	double slope;
 	double length;
-	void computeSlope();
-	void computeLength();
+	void setEnds(Point2d _p1, Point2d _p2, int scale);
 	int _scale;
 };
 
@@ -122,27 +122,67 @@ public:
 		ipm = _ipm;
 	}
 
+	//pitch of ipm from visual odometry : findPairs runs once per frame and the EKF of updateIPM2
+	//only corrects the drift every _ekfInterval frames. NULL : EKF on the lanes every frame.
+	void setOdometry(AsyncProcessVISO *_odometry, int _ekfInterval = 10) {
+		odometry = _odometry;
+		ekfInterval = _ekfInterval > 0 ? _ekfInterval : 1;
+	}
+
+	//search LSD segments and pairs only in corridors around the lanes of the last frame moved
+	//with the ego-motion, the whole image every _fullInterval frames. 0 : whole image every frame.
+	void setTracking(int _fullInterval) {
+		tracking = _fullInterval > 0;
+		laneTracker.param.full_interval = _fullInterval;
+		laneTracker.reset();
+	}
+	//pitch and height of the camera on the road for this frame (e.g. LidarGroundEstimator) : method3
+	//then runs findPairs once with them, neither the odometry nor the EKF of updateIPM2 are used
+	void setGroundPlane(double pitch, double h) {
+		groundPitch = pitch;
+		groundHeight = h;
+		groundPlaneExternal = true;
+	}
+	//threads evaluating the candidate pairs of findPairs, 0 : cv::getNumThreads(), 1 : serial.
+	//the pairs found don't depend on it, the overlaps are resolved after, in the serial order
+	void setPairThreads(int n) { pairThreads = n; }
+	//ego-motion of this frame (e.g. OXTS vf * dt, wz * dt); otherwise the odometry motion is used
+	void setEgoMotion(double forward, double yaw) {
+		laneTracker.setMotion(forward, yaw);
+		egoMotionExternal = true;
+	}
+
 	//step1 : LSD detection of lines
-	//work on rawGrayImage
-	ntuple_list resultLSD();
+	//work on rawGrayImage, only on the corridors of laneTracker if corridorSearch
+	const SegmentTable &resultLSD();
 
 	//step2 : update ipm (estimate rx)
 	//work on ipm and kf
 	void updateIPM(std::vector<Pair2d> pairs, std::vector<Pair2d> pairs_in_image);
 	void updateIPM2(std::vector<Pair2d> pairs_in_image);
+	bool updateIPMFromOdometry();//false if no motion is available for this frame
+	bool updateIPMFromGroundPlane();//false if setGroundPlane was not called for this frame
+	void startTracking();//before resultLSD : predict the lanes, choose corridor or full search
+	void updateTracking(const std::vector<Pair2d> &pairs);//after findPairs
 
 	void findPairs(std::vector<Pair2d> &pairs, std::vector<Pair2d> &pairs_in_image, const Mat &maskRoad = Mat(), int times = 0);
+	//findPairs again after updateIPM2 changed the pitch of ipm by less than pairCache.max_rx_delta :
+	//only the pairs found by the last findPairs and the pairs of the segments which entered
+	//the zone are evaluated again. A full findPairs otherwise.
+	void findPairsAgain(std::vector<Pair2d> &pairs, std::vector<Pair2d> &pairs_in_image, const Mat &maskRoad = Mat());
 	void checkPairs(std::vector<Pair2d> &pairs, std::vector<Pair2d> &pairs_in_image);
 
 	void detectionLineLSD(Mat &processImage);
 
 	void method1();
 	void method2(const Mat &img);
-	std::vector < std::vector<Pair2d> > method3(const Mat &img, int winFlag = 0, const Mat &maskRoad = Mat());
-	std::vector<Pair2d> method4(const Mat &rL, const Mat &disp, int winFlag = 0);//stereo
+	//gray : gray image of img if the caller has it (e.g. RectifyStereo::rectifyImages), not converted again
+	std::vector < std::vector<Pair2d> > method3(const Mat &img, int winFlag = 0, const Mat &maskRoad = Mat(), const Mat &gray = Mat());
+	//stereo. pairs on the ground and pairs in the image, as method3
+	std::vector < std::vector<Pair2d> > method4(const Mat &rL, const Mat &disp, int winFlag = 0, const Mat &gray = Mat());
 
 	void segmentationRoad(Mat &maskRoad);
-	void roadExtraFromDisp(const Mat &disp, Mat &maskRoad);
+	void roadExtraFromDisp(const Mat &disp, Mat &maskRoad);//disp may be smaller than the image (subsampling)
 
 	//double estimateRx(std::vector<Segment2d> *segments_in_image);
 
@@ -153,14 +193,56 @@ public:
 	int nameIndex;
 	CC::CC_SimpleIPM* ipm;
 	KalmanFilter kf;
-	EKalmanFilter ekf;
+	FixedEKalmanFilter<2> ekf;//vanishing point (x, y), updateIPM2 : all the segments in one information-form update per iteration
 	Point2d vp;//vanishing point
 	double vpy;
+	GroundLineEstimator groundLineEstimator;//road line in v-disparity for method4
+	DisparityHistogram disparityHistogram;//v-disparity and u-disparity of the last disparity map
+	RoadMaskExtractor roadMaskExtractor;//road mask of method4, disparity map may be subsampled
+	AsyncProcessVISO *odometry;//see setOdometry
+	int ekfInterval;
+	int frameCount;
+	LaneTracker laneTracker;//see setTracking
+	bool tracking;
+	bool corridorSearch;//this frame is only searched in the corridors of laneTracker
+	bool egoMotionExternal;
+	bool groundPlaneExternal;
+	double groundPitch, groundHeight;//see setGroundPlane
+
+	//pair of segments i, j (indices of the in-view segments) accepted by evaluatePair
+	struct PairCandidate {
+		PairCandidate(int _i, int _j, const Pair2d &_pair, const Pair2d &_pair_img) : i(_i), j(_j), pair(_pair), pair_img(_pair_img) {}
+		int i, j;
+		Pair2d pair;//on the ground
+		Pair2d pair_img;
+	};
+	int pairThreads;//see setPairThreads
+	GroundSampler groundSampler;//gray levels of the road for the color test of evaluatePair
+	//work of the last findPairs, reused by findPairsAgain
+	struct PairCache {
+		bool valid;//false after resultLSD
+		double rx;//pitch of ipm when the candidates were evaluated
+		double max_rx_delta;
+		std::vector<int> lsd_index;//lsd segment of each in-view segment
+		std::vector<Point> candidates;//lsd segments of the pairs accepted by evaluatePair
+	} pairCache;
+
+	//segments of lsdSegments in the zone (x_min, x_max, z_min, z_max), with their ground columns
+	void projectSegments(SegmentTable &view);
+	//geometry and color tests of the pair (i, j), appended to candidates if they pass.
+	//may run concurrently for different pairs
+	bool evaluatePair(const SegmentTable &view, int i, int j, std::vector<PairCandidate> &candidates);
+	//evaluatePair on all the pairs (i, j) of the segments, or on the list ij, with pairThreads threads.
+	//candidates are in the order of the serial search
+	void evaluatePairs(const SegmentTable &view, const std::vector<Point> *ij, std::vector<PairCandidate> &candidates);
+	//overlap and road mask tests of the candidates, in order
+	void mergePairs(std::vector<PairCandidate> &candidates, const SegmentTable &view,
+		const Mat &maskRoad, std::vector<Pair2d> &pairs, std::vector<Pair2d> &pairs_in_image);
 
 	static const int x_min = -10, x_max = 15;//x_min = -20, x_max = 15
 	static const int z_min = 6, z_max = 80;//z_min = 6, z_max = 80
 
 private:
-	ntuple_list lsd_result;
+	SegmentTable lsdSegments;//of the frame, see resultLSD
 	Vec3b roadColor;
 };
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "LaneResultWriter.h"
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+static const char RESULT_MAGIC[8] = { 'L', 'A', 'N', 'E', 'S', '0', '0', '1' };
+
+LaneResultWriter::LaneResultWriter(const string &fileName)
+{
+	out.open(fileName.c_str(), ios::binary | ios::trunc);
+	opened = out.is_open();
+	if (!opened)
+		cout << "LaneResultWriter : can not create " << fileName << endl;
+	else
+		out.write(RESULT_MAGIC, sizeof(RESULT_MAGIC));
+	quit = false;
+	worker = thread(&LaneResultWriter::run, this);
+}
+
+LaneResultWriter::~LaneResultWriter()
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		quit = true;
+	}
+	cond.notify_all();
+	worker.join();
+}
+
+void LaneResultWriter::append(vector<char> &buffer, const void *data, size_t size)
+{
+	const char *p = (const char*)data;
+	buffer.insert(buffer.end(), p, p + size);
+}
+
+void LaneResultWriter::appendPair(vector<char> &buffer, const Pair2d &p)
+{
+	float v[10] = {
+		(float)p.s1.p1.x, (float)p.s1.p1.y, (float)p.s1.p2.x, (float)p.s1.p2.y,
+		(float)p.s2.p1.x, (float)p.s2.p1.y, (float)p.s2.p2.x, (float)p.s2.p2.y,
+		(float)p.mean_width, (float)p.mean_color };
+	append(buffer, v, sizeof(v));
+}
+
+void LaneResultWriter::write(const LaneFrameResult &result, const vector<Pair2d> &pairs,
+	const vector<Pair2d> &pairs_in_image)
+{
+	if (!opened)
+		return;
+
+	record.clear();
+	int32_t head[3] = { result.frame, (int32_t)pairs.size(), (int32_t)pairs_in_image.size() };
+	float values[7] = { (float)result.pitch, (float)result.height, (float)result.vp.x, (float)result.vp.y,
+		result.time_ms[0], result.time_ms[1], result.time_ms[2] };
+	append(record, head, sizeof(head));
+	append(record, values, sizeof(values));
+	for (size_t i = 0; i < pairs.size(); i++)
+		appendPair(record, pairs[i]);
+	for (size_t i = 0; i < pairs_in_image.size(); i++)
+		appendPair(record, pairs_in_image[i]);
+
+	{
+		lock_guard<mutex> lock(mtx);
+		front.insert(front.end(), record.begin(), record.end());
+	}
+	cond.notify_all();
+}
+
+void LaneResultWriter::run()
+{
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(mtx);
+			cond.wait(lock, [this] { return !front.empty() || quit; });
+			if (front.empty())
+				break;//quit, everything is written
+			//the capacity of both buffers is kept : no allocation once the sizes are stable
+			back.swap(front);
+		}
+
+		out.write(&back[0], back.size());
+		back.clear();
+	}
+	out.flush();
+}
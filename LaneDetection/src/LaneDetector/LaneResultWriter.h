@@ -0,0 +1,56 @@
+#ifndef LANE_RESULT_WRITER_H
+#define LANE_RESULT_WRITER_H
+
+#include "LaneDetectionV2.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+//per frame values of a LaneResultWriter record, besides the pairs
+struct LaneFrameResult {
+	LaneFrameResult() : frame(0), pitch(0), height(0) { time_ms[0] = time_ms[1] = time_ms[2] = 0; }
+
+	int frame;
+	double pitch, height;//of ipm after the detection
+	Point2d vp;//vanishing point
+	float time_ms[3];//reading and rectifying, disparity, lane detection
+};
+
+//Binary log of the lanes of every frame, written by its own thread.
+//write() serializes the frame into the front buffer and returns, the thread swaps the buffers
+//and writes the back buffer to the file : the caller never waits for the disk.
+//
+//file : "LANES001", then per frame
+//  int32 frame, int32 n_pairs, int32 n_pairs_in_image, float pitch, height, vp.x, vp.y, time_ms[3]
+//  n_pairs + n_pairs_in_image pairs : float s1 (x1 y1 x2 y2), s2 (x1 y1 x2 y2), mean_width, mean_color
+//(ground pairs in meter, pairs in image in pixel, -1 : width or color not computed)
+class LaneResultWriter {
+public:
+	LaneResultWriter(const std::string &fileName);
+	~LaneResultWriter();//the frames written are all in the file when it returns
+
+	bool isOpen() const { return opened; }
+	void write(const LaneFrameResult &result, const std::vector<Pair2d> &pairs,
+		const std::vector<Pair2d> &pairs_in_image = std::vector<Pair2d>());
+
+private:
+	void run();
+	static void append(std::vector<char> &buffer, const void *data, size_t size);
+	static void appendPair(std::vector<char> &buffer, const Pair2d &p);
+
+	std::ofstream out;
+	bool opened;
+	std::vector<char> front;//filled by write()
+	std::vector<char> back;//written by the thread
+	std::vector<char> record;//serialization of a frame, outside of the lock
+	bool quit;
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cond;
+};
+
+#endif
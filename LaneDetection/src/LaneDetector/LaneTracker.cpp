@@ -0,0 +1,195 @@
+#include "LaneTracker.h"
+#include <algorithm>
+using namespace std;
+
+LaneTracker::LaneTracker(const Param &_param)
+{
+	param = _param;
+	reset();
+}
+
+void LaneTracker::reset()
+{
+	lanes.clear();
+	setMotion(0, 0);
+	frames_since_full = param.full_interval;
+}
+
+void LaneTracker::setMotion(double forward, double yaw)
+{
+	//the vehicle moves along an arc : translation in the direction yaw / 2
+	double ox = -forward * sin(yaw / 2), oz = forward * cos(yaw / 2);
+	double c = cos(yaw), s = sin(yaw);
+	m00 = c, m02 = s;
+	m20 = -s, m22 = c;
+	tx = -(c * ox + s * oz);
+	tz = -(-s * ox + c * oz);
+}
+
+void LaneTracker::setMotion(const Matrix44 &motion)
+{
+	//p_cur = R * p_prev + t restricted to the ground plane (x, z) of the camera
+	m00 = motion.val[0][0], m02 = motion.val[0][2];
+	m20 = motion.val[2][0], m22 = motion.val[2][2];
+	tx = motion.val[0][3], tz = motion.val[2][3];
+}
+
+void LaneTracker::transform(double x, double z, double &xt, double &zt) const
+{
+	xt = m00 * x + m02 * z + tx;
+	zt = m20 * x + m22 * z + tz;
+}
+
+void LaneTracker::predict()
+{
+	for (int i = 0; i < (int)lanes.size(); i++)
+	{
+		TrackedLane &l = lanes[i];
+		double x1, z1, x2, z2;
+		transform(l.a * l.z1 + l.b, l.z1, x1, z1);
+		transform(l.a * l.z2 + l.b, l.z2, x2, z2);
+		if (abs(z2 - z1) < 1e-6)
+			continue;
+		l.a = (x2 - x1) / (z2 - z1);
+		l.b = x1 - l.a * z1;
+		l.z1 = min(z1, z2);
+		l.z2 = max(z1, z2);
+	}
+	frames_since_full++;
+}
+
+bool LaneTracker::needFullSearch() const
+{
+	return lanes.empty() || frames_since_full >= param.full_interval;
+}
+
+void LaneTracker::getROIs(const CC::CC_SimpleIPM &ipm, Size image_size, double z_min, double z_max, vector<Rect> &rois) const
+{
+	rois.clear();
+	Rect image_rect(0, 0, image_size.width, image_size.height);
+	int n_pieces = max(1, param.roi_pieces);
+
+	for (int i = 0; i < (int)lanes.size(); i++)
+	{
+		const TrackedLane &l = lanes[i];
+		//pieces of equal length in the image : geometric in z
+		double ratio = pow(z_max / z_min, 1.0 / n_pieces);
+		double z_a = z_min;
+		for (int k = 0; k < n_pieces; k++)
+		{
+			double z_b = z_a * ratio;
+			double u_min = DBL_MAX, u_max = -DBL_MAX, v_min = DBL_MAX, v_max = -DBL_MAX;
+			double corners[4][2] = {
+				{ l.a * z_a + l.b - param.corridor_width, z_a }, { l.a * z_a + l.b + param.corridor_width, z_a },
+				{ l.a * z_b + l.b - param.corridor_width, z_b }, { l.a * z_b + l.b + param.corridor_width, z_b } };
+			for (int c = 0; c < 4; c++)
+			{
+				double u, v;
+				ipm.convert_inv(corners[c][0], corners[c][1], u, v);
+				u_min = min(u_min, u), u_max = max(u_max, u);
+				v_min = min(v_min, v), v_max = max(v_max, v);
+			}
+			z_a = z_b;
+
+			Rect roi((int)floor(u_min) - param.roi_margin, (int)floor(v_min) - param.roi_margin,
+				(int)ceil(u_max - u_min) + 2 * param.roi_margin, (int)ceil(v_max - v_min) + 2 * param.roi_margin);
+			roi &= image_rect;
+			if (roi.width > 1 && roi.height > 1)
+				rois.push_back(roi);
+		}
+	}
+
+	//merge overlapping ROIs, so that no segment is detected twice
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (int i = 0; i < (int)rois.size() && !merged; i++)
+		{
+			for (int j = i + 1; j < (int)rois.size(); j++)
+			{
+				if ((rois[i] & rois[j]).area() > 0)
+				{
+					rois[i] |= rois[j];
+					rois.erase(rois.begin() + j);
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+}
+
+bool LaneTracker::inCorridor(double x, double z) const
+{
+	for (int i = 0; i < (int)lanes.size(); i++)
+	{
+		if (abs(x - (lanes[i].a * z + lanes[i].b)) < param.corridor_width)
+			return true;
+	}
+	return false;
+}
+
+void LaneTracker::update(const vector<Vec4d> &lines, bool full_search)
+{
+	vector<TrackedLane> found;
+
+	//longest lines first, a shorter line close to a lane only extends it
+	vector<int> order(lines.size());
+	vector<double> length(lines.size());
+	for (int i = 0; i < (int)lines.size(); i++)
+	{
+		order[i] = i;
+		double dx = lines[i][2] - lines[i][0], dz = lines[i][3] - lines[i][1];
+		length[i] = sqrt(dx * dx + dz * dz);
+	}
+	sort(order.begin(), order.end(), [&length](int i, int j) { return length[i] > length[j]; });
+
+	for (int k = 0; k < (int)order.size(); k++)
+	{
+		const Vec4d &li = lines[order[k]];
+		double z1 = min(li[1], li[3]), z2 = max(li[1], li[3]);
+		if (z2 - z1 < 1e-3)
+			continue;//across the road, not a lane line
+		double a = (li[2] - li[0]) / (li[3] - li[1]);
+		double b = li[0] - a * li[1];
+
+		double z_mid = (z1 + z2) / 2;
+		bool merged = false;
+		for (int i = 0; i < (int)found.size() && !merged; i++)
+		{
+			if (abs(found[i].a * z_mid + found[i].b - (a * z_mid + b)) < param.merge_dist)
+			{
+				found[i].z1 = min(found[i].z1, z1);
+				found[i].z2 = max(found[i].z2, z2);
+				merged = true;
+			}
+		}
+		if (!merged && (int)found.size() < param.max_lanes)
+		{
+			TrackedLane l = { a, b, z1, z2, 0 };
+			found.push_back(l);
+		}
+	}
+
+	//lanes not found again are kept for a few frames
+	if (!full_search)
+	{
+		for (int i = 0; i < (int)lanes.size(); i++)
+		{
+			TrackedLane l = lanes[i];
+			if (++l.age > param.max_age || (int)found.size() >= param.max_lanes)
+				continue;
+			double z_mid = (l.z1 + l.z2) / 2;
+			bool matched = false;
+			for (int j = 0; j < (int)found.size() && !matched; j++)
+				matched = abs(found[j].a * z_mid + found[j].b - (l.a * z_mid + l.b)) < param.merge_dist;
+			if (!matched)
+				found.push_back(l);
+		}
+	}
+
+	lanes = found;
+	if (full_search)
+		frames_since_full = 0;
+}
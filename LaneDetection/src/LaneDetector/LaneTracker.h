@@ -0,0 +1,69 @@
+#pragma once
+
+#include <opencv2\opencv.hpp>
+#include "../ConverterCoordinates/CC.h"
+#include "../ELAS_VisualOdometry/matrix_fixed.h"
+using namespace cv;
+
+//lane line on the ground plane of the camera : x = a * z + b (m), found for z in [z1, z2]
+struct TrackedLane {
+	double a, b;
+	double z1, z2;
+	int age;//frames since the lane was last found
+};
+
+//LaneTracker keeps the lane lines of the last frame on the ground plane, moves them with the
+//ego-motion and gives the corridors where the next frame is searched : image ROIs for LSD and
+//ground-plane bands for the pairing. A full-frame search is asked every full_interval frames
+//and as soon as no lane is tracked any more.
+class LaneTracker {
+public:
+	struct Param {
+		Param() : full_interval(10), corridor_width(1.0), merge_dist(0.6), max_lanes(6), max_age(2),
+			roi_pieces(4), roi_margin(8) {}
+
+		int full_interval;
+		double corridor_width;//half width of a corridor around a predicted lane (m)
+		double merge_dist;//lines closer than merge_dist (m) belong to the same lane
+		int max_lanes;
+		int max_age;//frames a lane is predicted without being found again
+		int roi_pieces;//a corridor is covered by roi_pieces ROIs along z
+		int roi_margin;//pixels added around each ROI
+	};
+
+	LaneTracker(const Param &_param = Param());
+
+	void reset();
+
+	//ego-motion previous -> current frame, used by the next predict() (constant velocity otherwise).
+	//forward in m and yaw in rad (positive to the left), e.g. OXTS vf * dt and wz * dt
+	void setMotion(double forward, double yaw);
+	//camera motion previous -> current frame (VisualOdometry::getMotion())
+	void setMotion(const Matrix44 &motion);
+
+	//move the lanes to the current frame
+	void predict();
+
+	bool needFullSearch() const;
+	int numLanes() const { return (int)lanes.size(); }
+	const std::vector<TrackedLane>& getLanes() const { return lanes; }
+
+	//image ROIs covering the corridors between z_min and z_max, overlapping ROIs are merged
+	void getROIs(const CC::CC_SimpleIPM &ipm, Size image_size, double z_min, double z_max, std::vector<Rect> &rois) const;
+
+	//true if the ground point (x, z) lies in a corridor
+	bool inCorridor(double x, double z) const;
+
+	//lines (x1, z1, x2, z2) on the ground found in this frame (e.g. Pair2d::_p12),
+	//full_search : the frame was searched entirely
+	void update(const std::vector<Vec4d> &lines, bool full_search);
+
+	Param param;
+
+private:
+	std::vector<TrackedLane> lanes;
+	double m00, m02, m20, m22, tx, tz;//ground-plane motion : x' = m00 x + m02 z + tx, z' = m20 x + m22 z + tz
+	int frames_since_full;
+
+	void transform(double x, double z, double &xt, double &zt) const;
+};
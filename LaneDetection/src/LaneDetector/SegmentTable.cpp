@@ -0,0 +1,103 @@
+#include "SegmentTable.h"
+#include "LaneDetectionV2.h"
+using namespace std;
+
+//as slope_seg of LaneDetectionV2.cpp
+static double slopeOf(double _x1, double _y1, double _x2, double _y2)
+{
+	if (abs(_x2 - _x1) < 1.0e-2) return 1.0e6;
+	return (_y2 - _y1) / (_x2 - _x1);
+}
+
+void SegmentTable::clear()
+{
+	u1.clear(), v1.clear(), u2.clear(), v2.clear();
+	slope_img.clear(), angle_img.clear(), length_img.clear();
+	width.clear();
+	lsd.clear();
+	x1.clear(), z1.clear(), x2.clear(), z2.clear();
+	slope.clear(), angle.clear(), length.clear();
+	zone_min.clear(), zone_max.clear();
+}
+
+void SegmentTable::reserve(int n)
+{
+	u1.reserve(n), v1.reserve(n), u2.reserve(n), v2.reserve(n);
+	slope_img.reserve(n), angle_img.reserve(n), length_img.reserve(n);
+	width.reserve(n);
+	lsd.reserve(n);
+	x1.reserve(n), z1.reserve(n), x2.reserve(n), z2.reserve(n);
+	slope.reserve(n), angle.reserve(n), length.reserve(n);
+	zone_min.reserve(n), zone_max.reserve(n);
+}
+
+void SegmentTable::appendLSD(const ntuple_list lsd_out, double dx, double dy)
+{
+	for (unsigned int i = 0; i < lsd_out->size; i++)
+	{
+		const double *p = lsd_out->values + i * lsd_out->dim;
+		double _u1 = p[0] + dx, _v1 = p[1] + dy, _u2 = p[2] + dx, _v2 = p[3] + dy;
+		if (!(_v1 < _v2))
+			swap(_u1, _u2), swap(_v1, _v2);
+
+		double k = slopeOf(_u1, _v1, _u2, _v2);
+		lsd.push_back(size());
+		u1.push_back((float)_u1), v1.push_back((float)_v1);
+		u2.push_back((float)_u2), v2.push_back((float)_v2);
+		slope_img.push_back((float)k);
+		angle_img.push_back((float)atan(k));
+		length_img.push_back((float)sqrt((_u2 - _u1) * (_u2 - _u1) + (_v2 - _v1) * (_v2 - _v1)));
+		width.push_back((float)p[4]);
+	}
+}
+
+void SegmentTable::appendProjected(const SegmentTable &src, int k, double _x1, double _z1, double _x2, double _z2)
+{
+	u1.push_back(src.u1[k]), v1.push_back(src.v1[k]);
+	u2.push_back(src.u2[k]), v2.push_back(src.v2[k]);
+	slope_img.push_back(src.slope_img[k]);
+	angle_img.push_back(src.angle_img[k]);
+	length_img.push_back(src.length_img[k]);
+	width.push_back(src.width[k]);
+	lsd.push_back(src.lsd[k]);
+
+	if (!(_z1 < _z2))
+		swap(_x1, _x2), swap(_z1, _z2);
+	double s = slopeOf(_x1, _z1, _x2, _z2);
+	x1.push_back((float)_x1), z1.push_back((float)_z1);
+	x2.push_back((float)_x2), z2.push_back((float)_z2);
+	slope.push_back((float)s);
+	angle.push_back((float)atan(s));
+	length.push_back((float)sqrt((_x2 - _x1) * (_x2 - _x1) + (_z2 - _z1) * (_z2 - _z1)));
+	zone_min.push_back((int)min(_x1, _x2) / 3);
+	zone_max.push_back((int)max(_x1, _x2) / 3);
+}
+
+Segment2d SegmentTable::image(int k) const
+{
+	return Segment2d(Point2d(u1[k], v1[k]), Point2d(u2[k], v2[k]), slope_img[k], length_img[k]);
+}
+
+Segment2d SegmentTable::ground(int k) const
+{
+	return Segment2d(Point2d(x1[k], z1[k]), Point2d(x2[k], z2[k]), slope[k], length[k]);
+}
+
+bool SegmentTable::maybePair(int i, int j) const
+{
+	if (z1[j] < 0)
+		return false;
+	if (length[j] > length[i])
+		return false;
+	//Segment2d::isNeighbor
+	if (abs(zone_min[j] - zone_min[i]) >= 2 && abs(zone_max[j] - zone_max[i]) >= 2)
+		return false;
+
+	//slope difference
+	double dif_slope = (double)angle[i] - angle[j];
+	if (dif_slope > half_pi)
+		dif_slope -= CV_PI;
+	if (dif_slope < -half_pi)
+		dif_slope += CV_PI;
+	return abs(dif_slope) <= 5 * CV_PI / 180;
+}
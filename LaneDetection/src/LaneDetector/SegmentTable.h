@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include "../LSD1.5/lsd.h"
+
+class Segment2d;
+
+//Segments of a frame as a structure of arrays, one column per value : the loops over all the
+//segments (projection, pair tests) only load the columns they read.
+//Endpoints are ordered as in Segment2d : v1 <= v2 in the image, z1 <= z2 on the ground.
+//Slopes, angles and lengths are computed once, when the row is added.
+//Values are stored as float : the pair tests on the columns may differ from the double
+//Segment2d ones for values at a threshold.
+class SegmentTable {
+public:
+	int size() const { return (int)u1.size(); }
+	void clear();
+	void reserve(int n);
+
+	//segments of an lsd result (x1, y1, x2, y2, width) moved by (dx, dy), e.g. the corner of a ROI
+	void appendLSD(const ntuple_list lsd_out, double dx = 0, double dy = 0);
+	//row k of src (image columns and lsd row) with its ground endpoints
+	void appendProjected(const SegmentTable &src, int k, double _x1, double _z1, double _x2, double _z2);
+
+	Segment2d image(int k) const;
+	Segment2d ground(int k) const;
+	//Segment2d::maybePair of the ground segments i and j, on the columns
+	bool maybePair(int i, int j) const;
+
+	//image, pixel
+	std::vector<float> u1, v1, u2, v2;
+	std::vector<float> slope_img, angle_img, length_img;//angle = atan(slope)
+	std::vector<float> width;//of the lsd rectangle
+	std::vector<int> lsd;//row of the segment in the table of LaneDetection::resultLSD
+
+	//ground, meter. Empty in the table of resultLSD
+	std::vector<float> x1, z1, x2, z2;
+	std::vector<float> slope, angle, length;
+	std::vector<int> zone_min, zone_max;//Segment2d::indexZone[2], [3] : x of the ends, scale 3
+};
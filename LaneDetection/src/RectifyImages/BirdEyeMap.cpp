@@ -0,0 +1,102 @@
+#include "BirdEyeMap.h"
+
+
+BirdEyeMap::BirdEyeMap(const Calib_Data_Type &_calibData, bool _raw, const Param &_param)
+{
+	calibData = _calibData;
+	raw = _raw;
+	param = _param;
+	rows = (int)((param.z_max - param.z_min) * param.scale);
+	cols = (int)((param.x_max - param.x_min) * param.scale);
+	valid = false;
+	rx_map = h_map = 0;
+}
+
+bool BirdEyeMap::update(CC::CC_SimpleIPM &ipm)
+{
+	double rx, h;
+	ipm.getRxAndH(rx, h);
+	if (valid && rx == rx_map && h == h_map)
+		return false;
+
+	calRemapMatrix(ipm);
+	rx_map = rx;
+	h_map = h;
+	valid = true;
+	return true;
+}
+
+void BirdEyeMap::rectifiedToRaw(double u, double v, double &u_raw, double &v_raw) const
+{
+	//ray in the rectified camera, then in the raw camera : x_rect = R_rect_00 * x_raw
+	const double *P = calibData.P_rect_00;
+	const double *R = calibData.R_rect_00;
+	double xr = (u - P[2]) / P[0];
+	double yr = (v - P[6]) / P[5];
+	double X = R[0] * xr + R[3] * yr + R[6];
+	double Y = R[1] * xr + R[4] * yr + R[7];
+	double Z = R[2] * xr + R[5] * yr + R[8];
+	if (Z <= 0)
+	{
+		u_raw = v_raw = -1;
+		return;
+	}
+	double x = X / Z, y = Y / Z;
+
+	//distortion k1, k2, p1, p2, k3 as cv::initUndistortRectifyMap
+	const double *D = calibData.D_00;
+	const double *K = calibData.K_00;
+	double r2 = x * x + y * y;
+	double radial = 1 + r2 * (D[0] + r2 * (D[1] + r2 * D[4]));
+	double xd = x * radial + 2 * D[2] * x * y + D[3] * (r2 + 2 * x * x);
+	double yd = y * radial + D[2] * (r2 + 2 * y * y) + 2 * D[3] * x * y;
+	u_raw = K[0] * xd + K[2];
+	v_raw = K[4] * yd + K[5];
+}
+
+void BirdEyeMap::calRemapMatrix(CC::CC_SimpleIPM &ipm)
+{
+	Mat mapx(rows, cols, CV_32FC1), mapy(rows, cols, CV_32FC1);
+	int width = raw ? calibData.S_00[0] : calibData.S_rect_00[0];
+	int height = raw ? calibData.S_00[1] : calibData.S_rect_00[1];
+	validMask.create(rows, cols, CV_8UC1);
+
+	for (int r = 0; r < rows; r++)
+	{
+		double z = param.z_min + (rows - 1 - r) / param.scale;
+		float *ptr_row_x = mapx.ptr<float>(r);
+		float *ptr_row_y = mapy.ptr<float>(r);
+		uchar *ptr_row_mask = validMask.ptr<uchar>(r);
+		for (int c = 0; c < cols; c++)
+		{
+			double x = param.x_min + c / param.scale;
+			double u, v;
+			ipm.convert_inv(x, z, u, v);
+			if (raw)
+				rectifiedToRaw(u, v, u, v);
+
+			bool in_image = u >= 0 && u <= width - 1 && v >= 0 && v <= height - 1;
+			ptr_row_x[c] = in_image ? (float)u : -1;
+			ptr_row_y[c] = in_image ? (float)v : -1;
+			ptr_row_mask[c] = in_image ? 255 : 0;
+		}
+	}
+	convertMaps(mapx, mapy, remapM[0], remapM[1], CV_16SC2);
+}
+
+void BirdEyeMap::warp(const Mat &image, Mat &birdEye)
+{
+	if (!valid)
+	{
+		cerr << "ERROR! BirdEyeMap : update() with an ipm model first!" << endl;
+		return;
+	}
+
+	remap(image, birdEye, remapM[0], remapM[1], cv::INTER_LINEAR, BORDER_CONSTANT, Scalar::all(0));
+}
+
+void BirdEyeMap::warp(const Mat &image, Mat &birdEye, Mat &mask)
+{
+	warp(image, birdEye);
+	validMask.copyTo(mask);
+}
@@ -0,0 +1,52 @@
+#ifndef BIRD_EYE_MAP_H
+#define BIRD_EYE_MAP_H
+#include "..\KITTI_Data_Reader\KITTI_Data_Reader.h"
+#include "..\ConverterCoordinates\CC.h"
+#include <opencv2\opencv.hpp>
+using namespace cv;
+
+//BirdEyeMap gives for each cell of a top-down grid of the ground (x to the right, z forward, in m)
+//its pixel in the raw distorted image of camera 00 : ground -> rectified image (CC_SimpleIPM) ->
+//rectified ray (P_rect_00) -> camera ray (R_rect_00) -> raw pixel (K_00, D_00). The bird's-eye view
+//of a raw image is then a single remap, without rectifying the whole image first.
+//The maps are computed again only when the pitch or the height of the ipm model change.
+class BirdEyeMap{
+
+public:
+	//grid of the bird's-eye view, same layout as InterfaceProcessIPMImage : z_max on the first row
+	struct Param{
+		Param() : x_min(-10), x_max(10), z_min(5), z_max(25), scale(20) {}
+		double x_min, x_max;
+		double z_min, z_max;
+		double scale;//pixels per m
+	};
+
+	//raw : the images given to warp are not rectified
+	BirdEyeMap(const Calib_Data_Type &_calibData, bool _raw = true, const Param &_param = Param());
+
+	//true if the maps were computed again
+	bool update(CC::CC_SimpleIPM &ipm);
+
+	//top-down view of image (raw or rectified, see the constructor), same type as image.
+	//mask : 255 on the cells seen by the camera
+	void warp(const Mat &image, Mat &birdEye);
+	void warp(const Mat &image, Mat &birdEye, Mat &mask);
+
+	Size size() const { return Size(cols, rows); }
+
+	Param param;
+
+private:
+	void calRemapMatrix(CC::CC_SimpleIPM &ipm);
+	void rectifiedToRaw(double u, double v, double &u_raw, double &v_raw) const;
+
+	Calib_Data_Type calibData;
+	bool raw;
+	int rows, cols;
+	bool valid;
+	double rx_map, h_map;//ipm model of the maps
+	Mat remapM[2];//fixed-point maps of cv::convertMaps
+	Mat validMask;
+};
+
+#endif
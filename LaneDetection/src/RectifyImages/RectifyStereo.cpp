@@ -11,6 +11,10 @@ RectifyStereo::RectifyStereo(string fileName, int _r){
 	rectified = _r;
 	loadParam(fileName.c_str());
 }
+RectifyStereo::RectifyStereo(const Calib_Data_Type &_calibData, int _r){
+	rectified = _r;
+	loadParam(_calibData);
+}
 void RectifyStereo::loadParam(string fileName){
 	loadParam(fileName.c_str());
 }
@@ -24,8 +28,14 @@ void RectifyStereo::loadParam(const char* fileName){
 		return;
 	}
 
-	if_in >> calibData;
+	Calib_Data_Type _calibData;
+	if_in >> _calibData;
 	if_in.close();
+	loadParam(_calibData);
+}
+
+void RectifyStereo::loadParam(const Calib_Data_Type &_calibData){
+	calibData = _calibData;
 	calRemapMatrix();
 	isLoadCameraParam = true;
 	for (int i = 0; i < 2; i++)
@@ -118,26 +128,92 @@ void RectifyStereo::calRemapMatrix(){
 	if (!rectified)
 	{
 		//compute remapM[2][2]
+		Mat mapx, mapy;
 		initUndistortRectifyMap(
 			K_00, D_00, R_rect_00, P_rect_00, S_rect_00, CV_32FC1,
-			remapM[0][0], remapM[0][1]);
+			mapx, mapy);
+		convertMaps(mapx, mapy, remapM[0][0], remapM[0][1], CV_16SC2);
 
 		initUndistortRectifyMap(
 			K_01, D_01, R_rect_01, P_rect_01, S_rect_00, CV_32FC1,
-			remapM[1][0], remapM[1][1]);
+			mapx, mapy);
+		convertMaps(mapx, mapy, remapM[1][0], remapM[1][1], CV_16SC2);
 	}
 }
 
+//stripes of rows of both cameras : s < n_stripes is the left camera
+class RectifyBody : public ParallelLoopBody {
+public:
+	RectifyBody(const Mat *_src, Mat *_dst, Mat *_gray, const Mat (*_maps)[2], int _n_stripes) :
+		src(_src), dst(_dst), gray(_gray), maps(_maps), n_stripes(_n_stripes) {}
+
+	void operator()(const Range &range) const
+	{
+		for (int s = range.start; s < range.end; s++)
+		{
+			int c = s / n_stripes;
+			int rows = dst[c].rows;
+			int r0 = rows * (s % n_stripes) / n_stripes;
+			int r1 = rows * (s % n_stripes + 1) / n_stripes;
+
+			Mat dst_rows = dst[c].rowRange(r0, r1);
+			remap(src[c], dst_rows, maps[c][0].rowRange(r0, r1), maps[c][1].rowRange(r0, r1), cv::INTER_LINEAR);
+			//while the stripe is in the cache
+			if (gray != NULL && dst_rows.channels() == 3)
+			{
+				Mat gray_rows = gray[c].rowRange(r0, r1);
+				cvtColor(dst_rows, gray_rows, CV_BGR2GRAY);
+			}
+		}
+	}
+
+private:
+	const Mat *src;
+	Mat *dst;
+	Mat *gray;
+	const Mat (*maps)[2];
+	int n_stripes;
+};
+
 void RectifyStereo::rectifyImages(const Mat &L, const Mat &R, Mat &rL, Mat &rR){
+	rectify(L, R, rL, rR, NULL);
+}
+
+void RectifyStereo::rectifyImages(const Mat &L, const Mat &R, Mat &rL, Mat &rR, Mat &grayL, Mat &grayR){
+	Mat gray[2];
+	if (!rectify(L, R, rL, rR, gray))
+		return;
+	grayL = gray[0];
+	grayR = gray[1];
+}
+
+bool RectifyStereo::rectify(const Mat &L, const Mat &R, Mat &rL, Mat &rR, Mat *gray){
 	if (!isLoadCameraParam)
 	{
 		cerr << "ERROR! Camera Parameters are not availabe!" << endl;
-		return;
+		return false;
+	}
+
+	Mat src[2] = { L, R };
+	Mat dst[2];
+	for (int c = 0; c < 2; c++)
+	{
+		dst[c].create(remapM[c][0].size(), src[c].type());
+		if (gray != NULL)
+		{
+			if (src[c].channels() == 3)
+				gray[c].create(dst[c].size(), CV_8UC1);
+			else
+				gray[c] = dst[c];
+		}
 	}
 
-	remap(L, rL, remapM[0][0], remapM[0][1], cv::INTER_LINEAR);
-	remap(R, rR, remapM[1][0], remapM[1][1], cv::INTER_LINEAR);
+	int n_stripes = max(1, getNumThreads());
+	parallel_for_(Range(0, 2 * n_stripes), RectifyBody(src, dst, gray, remapM, n_stripes), 2 * n_stripes);
 
+	rL = dst[0];
+	rR = dst[1];
+	return true;
 }
 
 void RectifyStereo::getROI(const Mat &rL, const Mat &rR, Mat &roiL, Mat & roiR){
@@ -11,19 +11,25 @@ public:
 
 	RectifyStereo(const char* fileName, int rectified = 0);//load parameter file and compute remap matrix.
 	RectifyStereo(string fileName, int rectified = 0);//load parameter file and compute remap matrix.
+	RectifyStereo(const Calib_Data_Type &_calibData, int rectified = 0);//e.g. the calibration of a SequencePack
 	void loadParam(const char* fileName);//load parameter file and compute remap matrix.
 	void loadParam(string fileName);//load parameter file and compute remap matrix.
+	void loadParam(const Calib_Data_Type &_calibData);//compute remap matrix.
 
+	//both cameras are rectified at once, by stripes of rows on all threads
 	void rectifyImages(const Mat &L, const Mat &R, Mat &rL, Mat &rR);
+	//also the gray images, converted stripe by stripe just after the remap (rL, rR if L, R are gray)
+	void rectifyImages(const Mat &L, const Mat &R, Mat &rL, Mat &rR, Mat &grayL, Mat &grayR);
 	void getROI(const Mat &rL, const Mat &rR, Mat &roiL, Mat & roiR);
 	Calib_Data_Type calibData;
 	bool isLoadCameraParam;
 
 private:
 	void calRemapMatrix();
+	bool rectify(const Mat &L, const Mat &R, Mat &rL, Mat &rR, Mat *gray);//gray : NULL or 2 Mat
 	
 	bool rectified;
-	Mat remapM[2][2];
+	Mat remapM[2][2];//fixed-point maps of cv::convertMaps : integer coordinates (CV_16SC2), interpolation weights (CV_16UC1)
 	Rect roi[2];
 };
 
@@ -0,0 +1,138 @@
+#include "DisparityHistogram.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DISP_HIST_USE_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+inline int lowestBit(int mask) { unsigned long index; _BitScanForward(&index, mask); return (int)index; }
+#else
+inline int lowestBit(int mask) { return __builtin_ctz(mask); }
+#endif
+#endif
+
+using namespace std;
+
+//one stripe of rows : v-disparity rows are disjoint between stripes, u-disparity is partial
+class DisparityHistogramBody : public ParallelLoopBody {
+public:
+	DisparityHistogramBody(const Mat &_disp, DisparityHistogram *_hist, int _flags,
+		int _min_disparity, int _row_start, int _n_stripes) :
+		disp(_disp), hist(_hist), flags(_flags),
+		min_disparity(_min_disparity), row_start(_row_start), n_stripes(_n_stripes) {}
+
+	void operator()(const Range &range) const
+	{
+		bool do_v = (flags & DisparityHistogram::V_DISPARITY) != 0;
+		bool do_u = (flags & DisparityHistogram::U_DISPARITY) != 0;
+		int rows_total = disp.rows - row_start;
+
+		for (int s = range.start; s < range.end; s++)
+		{
+			int r0 = row_start + rows_total * s / n_stripes;
+			int r1 = row_start + rows_total * (s + 1) / n_stripes;
+
+			Mat u_part;
+			if (do_u)
+			{
+				u_part = (s == 0 ? hist->udisp : hist->partial_udisp[s - 1]);
+				u_part.setTo(Scalar(0));
+			}
+
+			for (int _r = r0; _r < r1; _r++)
+				scanRow(_r, do_v, do_u, u_part);
+		}
+	}
+
+private:
+	inline void count(int _c, int d, ushort *ptr_row_vdisp, Mat &u_part, bool do_v, bool do_u) const
+	{
+		if (do_v) ptr_row_vdisp[d]++;
+		if (do_u) u_part.ptr<ushort>(d)[_c]++;
+	}
+
+	void scanRow(int _r, bool do_v, bool do_u, Mat &u_part) const
+	{
+		const uchar* ptr_row_disp = disp.ptr<uchar>(_r);
+		ushort* ptr_row_vdisp = do_v ? hist->vdisp.ptr<ushort>(_r) : NULL;
+		int cols = disp.cols;
+
+		int _c = 0;
+#ifdef DISP_HIST_USE_SSE2
+		//unsigned compare d >= min_disparity done as signed compare after flipping the sign bit,
+		//blocks of 16 invalid pixels are skipped at once
+		const __m128i sign_bit = _mm_set1_epi8((char)0x80);
+		const __m128i threshold_v = _mm_set1_epi8((char)(min_disparity - 1 - 128));
+		for (; _c + 16 <= cols; _c += 16)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i*)(ptr_row_disp + _c));
+			int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_xor_si128(d, sign_bit), threshold_v));
+			while (mask)
+			{
+				int k = _c + lowestBit(mask);
+				count(k, ptr_row_disp[k], ptr_row_vdisp, u_part, do_v, do_u);
+				mask &= mask - 1;
+			}
+		}
+#endif
+		for (; _c < cols; _c++)
+		{
+			if (ptr_row_disp[_c] < min_disparity) continue;
+			count(_c, ptr_row_disp[_c], ptr_row_vdisp, u_part, do_v, do_u);
+		}
+	}
+
+	const Mat &disp;
+	DisparityHistogram *hist;
+	int flags;
+	int min_disparity;
+	int row_start;
+	int n_stripes;
+};
+
+DisparityHistogram::DisparityHistogram(int _n_stripes)
+{
+	n_stripes = _n_stripes;
+}
+
+void DisparityHistogram::compute(const Mat &disp, int flags, int min_disparity, int row_start)
+{
+	CV_Assert(disp.type() == CV_8UC1);
+
+	if (min_disparity < 1) min_disparity = 1;
+	if (row_start < 0) row_start = 0;
+	if (row_start > disp.rows) row_start = disp.rows;
+
+	int stripes = n_stripes > 0 ? n_stripes : max(1, getNumThreads());
+	stripes = max(1, min(stripes, disp.rows - row_start));
+
+	if (flags & V_DISPARITY)
+	{
+		vdisp.create(disp.rows, 256, CV_16UC1);
+		vdisp.setTo(Scalar(0));//rows < row_start stay empty
+	}
+	if (flags & U_DISPARITY)
+	{
+		udisp.create(256, disp.cols, CV_16UC1);
+		partial_udisp.resize(stripes - 1);
+		for (int s = 0; s < stripes - 1; s++)
+			partial_udisp[s].create(256, disp.cols, CV_16UC1);
+	}
+
+	if (min_disparity > 255 || row_start == disp.rows)
+	{
+		if (flags & U_DISPARITY)
+			udisp.setTo(Scalar(0));
+		return;
+	}
+
+	parallel_for_(Range(0, stripes),
+		DisparityHistogramBody(disp, this, flags, min_disparity, row_start, stripes), stripes);
+
+	//merge partial u-disparity, a column has at most disp.rows counts so 16 bits is enough
+	if (flags & U_DISPARITY)
+	{
+		for (int s = 0; s < stripes - 1; s++)
+			add(udisp, partial_udisp[s], udisp);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef DISPARITY_HISTOGRAM_H
+#define DISPARITY_HISTOGRAM_H
+
+#include <opencv2\opencv.hpp>
+#include <vector>
+using namespace cv;
+
+//Builds v-disparity (rows x 256) and u-disparity (256 x cols) of an 8-bit disparity map
+//in one pass, 16-bit counts. Rows are split in stripes processed in parallel: each stripe
+//owns its rows of v-disparity and a partial u-disparity, partials are merged at the end.
+//Buffers are kept between frames, so keep one instance per image size.
+class DisparityHistogram {
+public:
+	enum {
+		V_DISPARITY = 1,
+		U_DISPARITY = 2
+	};
+
+	DisparityHistogram(int _n_stripes = 0);//0 : one stripe per thread of opencv
+
+	//disp : CV_8UC1. Only rows >= row_start and disparities >= min_disparity are counted.
+	void compute(const Mat &disp, int flags = V_DISPARITY | U_DISPARITY, int min_disparity = 5, int row_start = 0);
+
+	Mat vdisp;//CV_16UC1, disp.rows x 256
+	Mat udisp;//CV_16UC1, 256 x disp.cols
+
+private:
+	int n_stripes;
+	std::vector<Mat> partial_udisp;//one per stripe except the first which writes to udisp
+
+	friend class DisparityHistogramBody;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "GroundLineEstimator.h"
+#include <algorithm>
+
+using namespace std;
+
+void GroundLineEstimator::collectCells(const Mat &vdisp, vector<Cell> &cells) const
+{
+	cells.clear();
+	int d_min = max(param.min_disparity, 1);
+	for (int _r = 0; _r < vdisp.rows; _r++)
+	{
+		const ushort* ptr_row_vdisp = vdisp.ptr<ushort>(_r);
+		int row_max = 0;
+		for (int d = d_min; d < vdisp.cols; d++)
+			if (ptr_row_vdisp[d] > row_max) row_max = ptr_row_vdisp[d];
+
+		if (row_max < param.min_count)
+			continue;
+
+		int thre = max(param.min_count, (int)(param.peak_ratio * row_max + 0.5));
+		for (int d = d_min; d < vdisp.cols; d++)
+		{
+			if (ptr_row_vdisp[d] < thre) continue;
+			Cell c;
+			c.d = (float)d;
+			c.v = (float)_r;
+			c.w = (float)ptr_row_vdisp[d];
+			cells.push_back(c);
+		}
+	}
+}
+
+bool GroundLineEstimator::fitWeighted(const vector<Cell> &cells, const vector<int> &inliers,
+	double &slope, double &intercept) const
+{
+	//minimize sum w * (v - slope * d - intercept)^2
+	double sw = 0, sd = 0, sv = 0, sdd = 0, sdv = 0;
+	for (size_t i = 0; i < inliers.size(); i++)
+	{
+		const Cell &c = cells[inliers[i]];
+		sw += c.w;
+		sd += c.w * c.d;
+		sv += c.w * c.v;
+		sdd += c.w * c.d * c.d;
+		sdv += c.w * c.d * c.v;
+	}
+	double det = sw * sdd - sd * sd;
+	if (sw <= 0 || abs(det) < 1e-9)
+		return false;
+
+	slope = (sw * sdv - sd * sv) / det;
+	intercept = (sv - slope * sd) / sw;
+	return true;
+}
+
+bool GroundLineEstimator::estimate(const Mat &vdisp, double cv, double f, GroundLine &line) const
+{
+	CV_Assert(vdisp.type() == CV_16UC1);
+	line = GroundLine();
+
+	vector<Cell> cells;
+	collectCells(vdisp, cells);
+	int n_cells = cells.size();
+	if (n_cells < 2)
+		return false;
+
+	//cumulative weights for weighted sampling
+	vector<double> cumul(n_cells);
+	double total = 0;
+	for (int i = 0; i < n_cells; i++)
+	{
+		total += cells[i].w;
+		cumul[i] = total;
+	}
+
+	RNG rng(param.seed);
+	double best_score = 0, best_slope = 0, best_intercept = 0;
+	for (int it = 0; it < param.ransac_iters; it++)
+	{
+		int i1 = lower_bound(cumul.begin(), cumul.end(), rng.uniform(0., total)) - cumul.begin();
+		int i2 = lower_bound(cumul.begin(), cumul.end(), rng.uniform(0., total)) - cumul.begin();
+		i1 = min(i1, n_cells - 1);
+		i2 = min(i2, n_cells - 1);
+
+		double dd = cells[i2].d - cells[i1].d;
+		if (abs(dd) < 1)
+			continue;
+		double slope = (cells[i2].v - cells[i1].v) / dd;
+		if (slope < param.slope_min || slope > param.slope_max)
+			continue;
+		double intercept = cells[i1].v - slope * cells[i1].d;
+
+		double score = 0;
+		for (int i = 0; i < n_cells; i++)
+		{
+			if (abs(cells[i].v - slope * cells[i].d - intercept) <= param.inlier_tol)
+				score += cells[i].w;
+		}
+		if (score > best_score)
+		{
+			best_score = score;
+			best_slope = slope;
+			best_intercept = intercept;
+		}
+	}
+
+	if (best_score <= 0)
+		return false;
+
+	//refinement on the inliers
+	vector<int> inliers;
+	for (int it = 0; it < param.refine_iters; it++)
+	{
+		inliers.clear();
+		for (int i = 0; i < n_cells; i++)
+		{
+			if (abs(cells[i].v - best_slope * cells[i].d - best_intercept) <= param.inlier_tol)
+				inliers.push_back(i);
+		}
+
+		double slope, intercept;
+		if (!fitWeighted(cells, inliers, slope, intercept))
+			break;
+		if (slope < param.slope_min || slope > param.slope_max)
+			break;
+		best_slope = slope;
+		best_intercept = intercept;
+	}
+
+	line.support = 0;
+	for (int i = 0; i < n_cells; i++)
+	{
+		if (abs(cells[i].v - best_slope * cells[i].d - best_intercept) <= param.inlier_tol)
+			line.support += cells[i].w;
+	}
+
+	line.slope = best_slope;
+	line.intercept = best_intercept;
+	line.vanishing_v = cv - best_intercept;
+	line.pitch = atan2(line.vanishing_v, f);
+	line.valid = true;
+	return true;
+}
+
+bool GroundLineEstimator::estimateFromDisparity(const Mat &disp, double cv, double f, GroundLine &line,
+	DisparityHistogram &hist, int flags) const
+{
+	hist.compute(disp, flags | DisparityHistogram::V_DISPARITY, param.min_disparity, (int)(disp.rows * param.row_start_ratio));
+	return estimate(hist.vdisp, cv, f, line);
+}
+
+void GroundLineEstimator::drawVDisparity(const Mat &vdisp, const GroundLine &line, Mat &out)
+{
+	double max_val;
+	minMaxLoc(vdisp, NULL, &max_val);
+	vdisp.convertTo(out, CV_8U, max_val > 0 ? 255.0 / max_val : 0);
+	cvtColor(out, out, CV_GRAY2BGR);
+
+	if (!line.valid)
+		return;
+
+	Point p0(0, (int)(line.intercept + 0.5));
+	Point p1(out.cols - 1, (int)(line.slope * (out.cols - 1) + line.intercept + 0.5));
+	cv::line(out, p0, p1, Scalar(255, 128, 0));
+}
@@ -0,0 +1,64 @@
+#ifndef GROUND_LINE_ESTIMATOR_H
+#define GROUND_LINE_ESTIMATOR_H
+
+#include <opencv2\opencv.hpp>
+#include "DisparityHistogram.h"
+using namespace cv;
+
+//road profile in v-disparity : v = slope * d + intercept
+struct GroundLine {
+	GroundLine() : slope(0), intercept(0), pitch(0), vanishing_v(0), support(0), valid(false) {}
+
+	double slope;//rows per unit of disparity
+	double intercept;//row of the line at d = 0 (horizon)
+	double pitch;//radian, atan2(cv - intercept, f)
+	double vanishing_v;//cv - intercept, kept for drawing
+	double support;//sum of the histogram counts of inliers
+	bool valid;
+};
+
+//Estimates the road line in v-disparity in a single pass instead of the iterative HoughLines.
+//The v-disparity is the 16-bit histogram of DisparityHistogram (rows x 256), the line is found
+//with a weighted RANSAC over the histogram cells followed by a weighted least squares refinement
+//on the inliers.
+//The number of hypotheses is fixed so the cost per frame is bounded.
+class GroundLineEstimator {
+public:
+	struct Param {
+		Param() :
+			min_disparity(5), row_start_ratio(0.5), slope_min(0.577), slope_max(1.732),
+			inlier_tol(2.0), peak_ratio(0.5), min_count(3), ransac_iters(200), refine_iters(2), seed(0x1234abcd) {}
+
+		int min_disparity;//disparities below are ignored (too far or invalid)
+		double row_start_ratio;//only rows >= row_start_ratio * rows vote
+		double slope_min, slope_max;//same range as HoughLines theta in [120, 150] degree
+		double inlier_tol;//in rows
+		double peak_ratio;//a cell is a candidate if count >= peak_ratio * (max of its row)
+		int min_count;
+		int ransac_iters;
+		int refine_iters;
+		uint64 seed;//fixed seed so that the result is reproducible
+	};
+
+	GroundLineEstimator(const Param &_param = Param()) : param(_param) {}
+
+	//cv, f : camera parameters, in the resolution of vdisp.
+	bool estimate(const Mat &vdisp, double cv, double f, GroundLine &line) const;
+	//hist.vdisp is (re)computed from disp, add DisparityHistogram::U_DISPARITY to flags to get hist.udisp too.
+	bool estimateFromDisparity(const Mat &disp, double cv, double f, GroundLine &line, DisparityHistogram &hist,
+		int flags = DisparityHistogram::V_DISPARITY) const;
+
+	//draw vdisp and the line for debugging
+	static void drawVDisparity(const Mat &vdisp, const GroundLine &line, Mat &out);
+
+	Param param;
+
+private:
+	struct Cell {
+		float d, v, w;
+	};
+	void collectCells(const Mat &vdisp, std::vector<Cell> &cells) const;
+	bool fitWeighted(const std::vector<Cell> &cells, const std::vector<int> &inliers, double &slope, double &intercept) const;
+};
+
+#endif
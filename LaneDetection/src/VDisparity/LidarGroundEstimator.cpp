@@ -0,0 +1,162 @@
+#include "LidarGroundEstimator.h"
+#include <algorithm>
+
+using namespace std;
+
+LidarGroundEstimator::LidarGroundEstimator(const Param &_param) : param(_param)
+{
+	const double I[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, O[3] = { 0, 0, 0 };
+	setVeloToCam(I, O, I);
+}
+
+void LidarGroundEstimator::setVeloToCam(const double R[9], const double T[3], const double R_rect[9])
+{
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			M[i * 3 + j] = R_rect[i * 3] * R[j] + R_rect[i * 3 + 1] * R[3 + j] + R_rect[i * 3 + 2] * R[6 + j];
+		t[i] = R_rect[i * 3] * T[0] + R_rect[i * 3 + 1] * T[1] + R_rect[i * 3 + 2] * T[2];
+	}
+}
+
+void LidarGroundEstimator::voxelize(const float *points, int n, vector<Point3f> &centroids) const
+{
+	//dense grid over the ROI : the ROI is small, cheaper than hashing the voxels
+	int nx = max(1, (int)ceil((param.x_max - param.x_min) / param.voxel));
+	int ny = max(1, (int)ceil(2 * param.y_max / param.voxel));
+	int nz = max(1, (int)ceil((param.z_max - param.z_min) / param.voxel));
+	vector<int> cell(nx * ny * nz, -1);
+	vector<Vec4d> sums;//x, y, z, count
+	float inv_voxel = (float)(1 / param.voxel);
+
+	for (int i = 0; i < n; i++)
+	{
+		const float *p = points + 4 * i;
+		if (p[0] < param.x_min || p[0] >= param.x_max || abs(p[1]) >= param.y_max ||
+			p[2] < param.z_min || p[2] >= param.z_max)
+			continue;
+		int ix = min(nx - 1, (int)((p[0] - param.x_min) * inv_voxel));
+		int iy = min(ny - 1, (int)((p[1] + param.y_max) * inv_voxel));
+		int iz = min(nz - 1, (int)((p[2] - param.z_min) * inv_voxel));
+		int &k = cell[(iz * ny + iy) * nx + ix];
+		if (k < 0)
+		{
+			k = (int)sums.size();
+			sums.push_back(Vec4d(0, 0, 0, 0));
+		}
+		Vec4d &s = sums[k];
+		s[0] += p[0], s[1] += p[1], s[2] += p[2], s[3] += 1;
+	}
+
+	centroids.resize(sums.size());
+	for (size_t k = 0; k < sums.size(); k++)
+		centroids[k] = Point3f((float)(sums[k][0] / sums[k][3]), (float)(sums[k][1] / sums[k][3]), (float)(sums[k][2] / sums[k][3]));
+}
+
+bool LidarGroundEstimator::refine(const vector<Point3f> &centroids, const vector<int> &inliers, GroundPlane &plane) const
+{
+	//minimize sum (z - a * x - b * y - c)^2, the plane is close to horizontal
+	double sxx = 0, sxy = 0, sx = 0, syy = 0, sy = 0, sxz = 0, syz = 0, sz = 0;
+	int cnt = inliers.size();
+	for (int i = 0; i < cnt; i++)
+	{
+		const Point3f &p = centroids[inliers[i]];
+		sxx += p.x * p.x, sxy += p.x * p.y, sx += p.x;
+		syy += p.y * p.y, sy += p.y;
+		sxz += p.x * p.z, syz += p.y * p.z, sz += p.z;
+	}
+	//normal equations [sxx sxy sx; sxy syy sy; sx sy cnt] * [a b c] = [sxz syz sz], Cramer's rule
+	double det = sxx * (syy * cnt - sy * sy) - sxy * (sxy * cnt - sy * sx) + sx * (sxy * sy - syy * sx);
+	if (abs(det) < 1e-9)
+		return false;
+	double abc[3];
+	abc[0] = (sxz * (syy * cnt - sy * sy) - sxy * (syz * cnt - sy * sz) + sx * (syz * sy - syy * sz)) / det;
+	abc[1] = (sxx * (syz * cnt - sz * sy) - sxz * (sxy * cnt - sy * sx) + sx * (sxy * sz - syz * sx)) / det;
+	abc[2] = (sxx * (syy * sz - sy * syz) - sxy * (sxy * sz - syz * sx) + sxz * (sxy * sy - syy * sx)) / det;
+
+	double norm = sqrt(abc[0] * abc[0] + abc[1] * abc[1] + 1);
+	plane.n[0] = -abc[0] / norm;
+	plane.n[1] = -abc[1] / norm;
+	plane.n[2] = 1 / norm;
+	plane.d = -abc[2] / norm;
+	return true;
+}
+
+void LidarGroundEstimator::toCamera(GroundPlane &plane) const
+{
+	//normal and closest point of the plane in the rectified camera frame (x right, y down, z forward)
+	double nc[3], pc[3];
+	for (int i = 0; i < 3; i++)
+	{
+		nc[i] = M[i * 3] * plane.n[0] + M[i * 3 + 1] * plane.n[1] + M[i * 3 + 2] * plane.n[2];
+		pc[i] = -plane.d * nc[i] + t[i];
+	}
+	//camera looking down by pitch : up = (0, -cos(pitch), -sin(pitch))
+	plane.pitch = atan2(-nc[2], -nc[1]);
+	plane.height = abs(nc[0] * pc[0] + nc[1] * pc[1] + nc[2] * pc[2]);
+}
+
+bool LidarGroundEstimator::estimate(const float *points, int n, GroundPlane &plane) const
+{
+	plane = GroundPlane();
+	vector<Point3f> centroids;
+	voxelize(points, n, centroids);
+	int n_c = centroids.size();
+	if (n_c < max(3, param.min_inliers))
+		return false;
+
+	double min_nz = cos(param.max_tilt * CV_PI / 180);
+	RNG rng(param.seed);
+	int best_count = 0;
+	double best_n[3] = { 0, 0, 1 }, best_d = 0;
+	for (int it = 0; it < param.ransac_iters; it++)
+	{
+		const Point3f &p1 = centroids[rng.uniform(0, n_c)];
+		const Point3f &p2 = centroids[rng.uniform(0, n_c)];
+		const Point3f &p3 = centroids[rng.uniform(0, n_c)];
+		double u[3] = { p2.x - p1.x, p2.y - p1.y, p2.z - p1.z };
+		double v[3] = { p3.x - p1.x, p3.y - p1.y, p3.z - p1.z };
+		double nv[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+		double len = sqrt(nv[0] * nv[0] + nv[1] * nv[1] + nv[2] * nv[2]);
+		if (len < 1e-6)
+			continue;//same or aligned points
+		if (nv[2] < 0)
+			len = -len;//normal up
+		nv[0] /= len, nv[1] /= len, nv[2] /= len;
+		if (nv[2] < min_nz)
+			continue;
+		double d = -(nv[0] * p1.x + nv[1] * p1.y + nv[2] * p1.z);
+
+		int count = 0;
+		for (int i = 0; i < n_c; i++)
+		{
+			const Point3f &p = centroids[i];
+			if (abs(nv[0] * p.x + nv[1] * p.y + nv[2] * p.z + d) < param.inlier_tol)
+				count++;
+		}
+		if (count > best_count)
+		{
+			best_count = count;
+			best_n[0] = nv[0], best_n[1] = nv[1], best_n[2] = nv[2];
+			best_d = d;
+		}
+	}
+	if (best_count < param.min_inliers)
+		return false;
+
+	vector<int> inliers;
+	inliers.reserve(best_count);
+	for (int i = 0; i < n_c; i++)
+	{
+		const Point3f &p = centroids[i];
+		if (abs(best_n[0] * p.x + best_n[1] * p.y + best_n[2] * p.z + best_d) < param.inlier_tol)
+			inliers.push_back(i);
+	}
+	if (!refine(centroids, inliers, plane))
+		return false;
+
+	plane.inliers = inliers.size();
+	toCamera(plane);
+	plane.valid = true;
+	return true;
+}
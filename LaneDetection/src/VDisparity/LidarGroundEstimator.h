@@ -0,0 +1,60 @@
+#ifndef LIDAR_GROUND_ESTIMATOR_H
+#define LIDAR_GROUND_ESTIMATOR_H
+
+#include <opencv2\opencv.hpp>
+using namespace cv;
+
+//road plane n . p + d = 0 (n unit, up) of a velodyne scan, and the pose of the camera on it
+struct GroundPlane {
+	GroundPlane() : d(0), pitch(0), height(0), inliers(0), valid(false) { n[0] = n[1] = 0; n[2] = 1; }
+
+	double n[3], d;//in the velodyne frame
+	double pitch;//radian, positive when the camera looks down (rx of CC_SimpleIPM::createModel)
+	double height;//of the camera above the plane (h of CC_SimpleIPM::createModel)
+	int inliers;
+	bool valid;
+};
+
+//Estimates the road plane from the velodyne points in front of the car, as GroundLineEstimator
+//does from the v-disparity, without the disparity map. The points of the ROI are reduced to
+//the centroids of their voxels, the plane is found with RANSAC over the centroids followed by
+//a least squares refinement on the inliers.
+//The number of hypotheses is fixed so the cost per frame is bounded.
+class LidarGroundEstimator {
+public:
+	struct Param {
+		Param() :
+			x_min(4), x_max(30), y_max(8), z_min(-3), z_max(0), voxel(0.25),
+			inlier_tol(0.08), max_tilt(15), min_inliers(50), ransac_iters(100), seed(0x1234abcd) {}
+
+		double x_min, x_max;//forward ROI, velodyne frame
+		double y_max;//|y| <= y_max
+		double z_min, z_max;//relative to the velodyne, the road is about 1.7 m below
+		double voxel;//side of the voxels
+		double inlier_tol;//in meter
+		double max_tilt;//degree, planes steeper than this are rejected
+		int min_inliers;
+		int ransac_iters;
+		uint64 seed;//fixed seed so that the result is reproducible
+	};
+
+	LidarGroundEstimator(const Param &_param = Param());
+
+	//p_cam = R_rect * (R * p_velo + T) : calib_velo_to_cam.txt (VelodyneScan::readCalibVeloToCam),
+	//R_rect_00 of calib_cam_to_cam.txt. Identity by default
+	void setVeloToCam(const double R[9], const double T[3], const double R_rect[9]);
+
+	//points : n points of 4 floats (x, y, z, reflectance), e.g. VelodyneScan::points()
+	bool estimate(const float *points, int n, GroundPlane &plane) const;
+
+	Param param;
+
+private:
+	double M[9], t[3];//velodyne to rectified camera 0
+
+	void voxelize(const float *points, int n, std::vector<Point3f> &centroids) const;
+	bool refine(const std::vector<Point3f> &centroids, const std::vector<int> &inliers, GroundPlane &plane) const;
+	void toCamera(GroundPlane &plane) const;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "RoadMaskExtractor.h"
+#include <algorithm>
+
+using namespace std;
+
+void RoadMaskExtractor::extract(const Mat &disp, const GroundLine &road, const Mat &udisp, Mat &mask) const
+{
+	CV_Assert(disp.type() == CV_8UC1);
+	mask = Mat::zeros(disp.size(), CV_8UC1);
+	if (!road.valid || road.slope <= 0)
+		return;
+
+	//relative to the number of rows, so that it doesn't depend on the subsampling
+	int obstacle_count = max(1, (int)(param.obstacle_ratio * disp.rows + 0.5));
+	bool use_udisp = !udisp.empty() && udisp.cols == disp.cols;
+
+	int r_start = max(0, (int)(road.intercept + 1));
+	for (int r = r_start; r < disp.rows; r++)
+	{
+		const uchar* ptr_row_disp = disp.ptr<uchar>(r);
+		uchar* ptr_row_mask = mask.ptr<uchar>(r);
+
+		double d_ground = (r - road.intercept) / road.slope;
+		int d0 = max(1, (int)(d_ground - param.band));
+		int d1 = min(255, (int)(d_ground + param.band));
+		if (d0 > d1) continue;
+
+		for (int c = 0; c < disp.cols; c++)
+		{
+			int d = ptr_row_disp[c];
+			if (d < d0 || d > d1) continue;
+			if (use_udisp && udisp.ptr<ushort>(d)[c] >= obstacle_count) continue;
+			ptr_row_mask[c] = 255;
+		}
+	}
+}
+
+void RoadMaskExtractor::upsample(const Mat &mask_low, const Mat &guide, Mat &mask) const
+{
+	CV_Assert(mask_low.type() == CV_8UC1 && guide.type() == CV_8UC1);
+	if (mask_low.size() == guide.size())
+	{
+		mask_low.copyTo(mask);
+		return;
+	}
+
+	Mat guide_low;
+	resize(guide, guide_low, mask_low.size(), 0, 0, INTER_AREA);
+
+	double weight_color[256];
+	for (int i = 0; i < 256; i++)
+		weight_color[i] = exp(-i * i / (2 * param.sigma_color * param.sigma_color));
+	double inv_2_sigma_space = 1.0 / (2 * param.sigma_space * param.sigma_space);
+
+	//low resolution pixel q is the image pixel q / sx (elas subsampling keeps the even pixels)
+	double sx = (double)mask_low.cols / guide.cols;
+	double sy = (double)mask_low.rows / guide.rows;
+	int cols_low = mask_low.cols, rows_low = mask_low.rows;
+
+	mask.create(guide.size(), CV_8UC1);
+	for (int y = 0; y < guide.rows; y++)
+	{
+		double yl = y * sy;
+		int y0 = min(max((int)floor(yl), 0), rows_low - 1);
+		int y1 = min(y0 + 1, rows_low - 1);
+		const uchar* ptr_row_guide = guide.ptr<uchar>(y);
+		uchar* ptr_row_mask = mask.ptr<uchar>(y);
+
+		for (int x = 0; x < guide.cols; x++)
+		{
+			double xl = x * sx;
+			int x0 = min(max((int)floor(xl), 0), cols_low - 1);
+			int x1 = min(x0 + 1, cols_low - 1);
+
+			//inside or outside of the road : nothing to refine
+			uchar m = mask_low.at<uchar>(y0, x0);
+			if (mask_low.at<uchar>(y0, x1) == m && mask_low.at<uchar>(y1, x0) == m && mask_low.at<uchar>(y1, x1) == m)
+			{
+				ptr_row_mask[x] = m;
+				continue;
+			}
+
+			//border : weighted vote of the 4x4 low resolution neighbours
+			int g = ptr_row_guide[x];
+			double sum_w = 0, sum_m = 0;
+			for (int yq = max(y0 - 1, 0); yq <= min(y0 + 2, rows_low - 1); yq++)
+			{
+				const uchar* ptr_row_mask_low = mask_low.ptr<uchar>(yq);
+				const uchar* ptr_row_guide_low = guide_low.ptr<uchar>(yq);
+				for (int xq = max(x0 - 1, 0); xq <= min(x0 + 2, cols_low - 1); xq++)
+				{
+					double dist2 = (xq - xl) * (xq - xl) + (yq - yl) * (yq - yl);
+					double w = exp(-dist2 * inv_2_sigma_space) * weight_color[abs(g - ptr_row_guide_low[xq])];
+					sum_w += w;
+					sum_m += w * ptr_row_mask_low[xq];
+				}
+			}
+			ptr_row_mask[x] = (sum_w > 0 && sum_m >= 127.5 * sum_w) ? 255 : 0;
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef ROAD_MASK_EXTRACTOR_H
+#define ROAD_MASK_EXTRACTOR_H
+
+#include <opencv2\opencv.hpp>
+#include "GroundLineEstimator.h"
+using namespace cv;
+
+//Road mask from a disparity map and its ground line : a pixel is road if its disparity is
+//close to the ground line of its row and its (u, d) cell of u-disparity is not an obstacle.
+//The disparity map may have a lower resolution than the image (ELAS subsampling), the mask
+//is then brought back to the image resolution with a joint bilateral upsampling guided by
+//the gray image, so that the borders of the mask follow the edges of the image.
+class RoadMaskExtractor {
+public:
+	struct Param {
+		Param() : band(15), obstacle_ratio(0.05), sigma_space(1.0), sigma_color(12.0) {}
+
+		int band;//disparity tolerance to the ground line (8-bit disparity units)
+		double obstacle_ratio;//a u-disparity cell is an obstacle if its count >= obstacle_ratio * rows
+		double sigma_space;//in pixels of the low resolution mask
+		double sigma_color;//in gray levels
+	};
+
+	RoadMaskExtractor(const Param &_param = Param()) : param(_param) {}
+
+	//disp : CV_8UC1; udisp : u-disparity of disp (DisparityHistogram), may be empty.
+	//mask : CV_8UC1 of the size of disp, 255 on road.
+	void extract(const Mat &disp, const GroundLine &road, const Mat &udisp, Mat &mask) const;
+
+	//mask_low : CV_8UC1; guide : CV_8UC1 image of the output resolution.
+	void upsample(const Mat &mask_low, const Mat &guide, Mat &mask) const;
+
+	Param param;
+};
+
+#endif
@@ -1,19 +1,101 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "KITTI_Data_Reader\KITTI_Data_Reader.h"
+#include "KITTI_Data_Reader\SequencePack.h"
+#include "KITTI_Data_Reader\FrameSource.h"
+#include "KITTI_Data_Reader\VelodyneScan.h"
 #include "RectifyImages\RectifyStereo.h"
+#include "RectifyImages\BirdEyeMap.h"
 #include "ELAS_VisualOdometry\InterfaceProcessVISO.h"
+#include "ELAS_VisualOdometry\AsyncProcessVISO.h"
 #include "ELAS_VisualOdometry\image.h"
 #include "ELAS_VisualOdometry\ELAS_Disparity_Interface.h"
+#include "ELAS_VisualOdometry\DisparityPredictor.h"
 #include "IPMImage\IPMImage.h"
+#include "IPMImage\RoadMosaic.h"
 #include "LaneDetector\LaneDetectionV2.h"
+#include "LaneDetector\LaneResultWriter.h"
+#include "VDisparity\LidarGroundEstimator.h"
 
 #include <iostream>
 using namespace std;
 
+//shows the bird's-eye view of every frame : one BirdEyeMap warp of the left image per frame
+//#define DEBUG_drawImage
+
+//ego-motion of the frame from the OXTS record of the source, for the lane tracking
+void setEgoMotionFromOxts(const FrameSource &source, LaneDetection *lsd_)
+{
+	const double frameTime = 0.1;//KITTI : 10 Hz
+	Oxts_Data_Type oxts;
+	if (!source.readOxts(oxts))
+		return;
+	lsd_->setEgoMotion(oxts.vf * frameTime, oxts.wz * frameTime);
+}
+
+//pitch and height of the camera from the velodyne scan of the frame, false without scan
+bool setGroundPlaneFromLidar(const FrameSource &source, const LidarGroundEstimator &estimator, LaneDetection *lsd_)
+{
+	VelodyneScan scan;
+	GroundPlane plane;
+	if (!source.readVelodyne(scan) || !estimator.estimate(scan.points(), scan.size(), plane))
+		return false;
+	lsd_->setGroundPlane(plane.pitch, plane.height);
+	return true;
+}
+
+//lanes of the frame in the result log, t0 .. tLanes : ticks at the start of the frame, after the
+//rectification, after the disparity map and after the lane detection
+void writeLaneResult(LaneResultWriter &writer, int frame, LaneDetection *lsd_, int64 t0, int64 tRead, int64 tDisp,
+	int64 tLanes, const vector<Pair2d> &pairs, const vector<Pair2d> &pairs_in_image)
+{
+	LaneFrameResult result;
+	result.frame = frame;
+	lsd_->ipm->getRxAndH(result.pitch, result.height);
+	result.vp = lsd_->vp;
+	double ms = 1000 / getTickFrequency();
+	result.time_ms[0] = (float)((tRead - t0) * ms);
+	result.time_ms[1] = (float)((tDisp - tRead) * ms);
+	result.time_ms[2] = (float)((tLanes - tDisp) * ms);
+	writer.write(result, pairs, pairs_in_image);
+}
+
+//calib_velo_to_cam.txt next to calibFileName, false if it is not there
+bool initLidarGround(const string &calibFileName, const Calib_Data_Type &calibData, LidarGroundEstimator &estimator)
+{
+	double R[9], T[3];
+	string veloCalibFileName = calibFileName.substr(0, calibFileName.find_last_of("\\/") + 1) + "calib_velo_to_cam.txt";
+	if (!VelodyneScan::readCalibVeloToCam(veloCalibFileName, R, T))
+		return false;
+	estimator.setVeloToCam(R, T, calibData.R_rect_00);
+	return true;
+}
+
+//gray image of an already rectified image (the rectifier gives it otherwise)
+void toGray(const Mat &img, Mat &gray)
+{
+	if (img.channels() > 1)
+		cvtColor(img, gray, CV_BGR2GRAY);
+	else
+		gray = img;
+}
+
+//frames of DataSetFolderName : 0 KITTI layout or .kpack, 1 side-by-side stereo video, 2 raw frame dump
+FrameSource* openFrameSource(int inputType, const string &DataSetFolderName, const string &formatImage,
+	const RawFrameSource::Param &rawParam)
+{
+	if (inputType == 1)
+		return new VideoFrameSource(DataSetFolderName);
+	if (inputType == 2)
+		return new RawFrameSource(DataSetFolderName, rawParam);
+	return new KITTIFrameSource(DataSetFolderName, formatImage);
+}
+
 void parse(string &DataSetFolderName, string &calibFileName, int &rectified,
 	int &frameInterval, float &h, int &methodeDisparity, int &noDisparity,
-	int &elasSetting, int &showTimeConsuming, float &pitch, string &formatImage)
+	int &elasSetting, int &showTimeConsuming, float &pitch, string &formatImage, int &odometryPitch, int &laneTracking,
+	int &packSequence, int &inputType, RawFrameSource::Param &rawParam, int &lidarGround,
+	int &resultLog, int &roadView, int &roadMosaic, int &pairThreads)
 {
 	ifstream in("config.txt");
 	if (!in.is_open())
@@ -32,6 +114,16 @@ void parse(string &DataSetFolderName, string &calibFileName, int &rectified,
 	in >> showTimeConsuming;
 	in >> pitch;
 	in >> formatImage;
+	in >> odometryPitch;
+	in >> laneTracking;
+	in >> packSequence;//0:replay DataSetFolderName (drive or .kpack); N:pack it into DataSetFolderName.kpack
+	in >> inputType;//0:KITTI layout or .kpack ; 1:side-by-side stereo video ; 2:raw frame dump
+	in >> rawParam.width >> rawParam.height >> rawParam.bayer;
+	in >> lidarGround;//0:pitch of the lanes or the disparity ; 1:pitch and height from the velodyne scans
+	in >> resultLog;//0:no log ; 1:lanes of every frame in lanes.bin
+	in >> roadView;//0:none ; 1:bird's-eye view of the road along the odometry ; 2:same, gather mode
+	in >> roadMosaic;//0:none ; 1:road views also gathered in the tiles of tiles.bin
+	in >> pairThreads;//0:all the threads of OpenCV ; N:N threads for the pairs of segments
 	in.close();
 }
 
@@ -56,17 +148,34 @@ int main2(){
 	int elasSetting = Elas::ROBOTICS;
 	int showTimeConsuming = 0;
 	float pitch = 0;
+	int odometryPitch = 0;
+	int laneTracking = 0;
+	int packSequence = 0;
+	int inputType = 0;
+	RawFrameSource::Param rawParam;
+	int lidarGround = 0;
+	int resultLog = 0;
+	int roadView = 0;
+	int roadMosaic = 0;
+	int pairThreads = 0;
 
 	//read config.txt to settings:
 	parse(DataSetFolderName, calibFileName, rectified, frameInterval, h,
-		methodeDisparity, noDisparity, elasSetting, showTimeConsuming, pitch, formatImage);
+		methodeDisparity, noDisparity, elasSetting, showTimeConsuming, pitch, formatImage, odometryPitch, laneTracking,
+		packSequence, inputType, rawParam, lidarGround, resultLog, roadView, roadMosaic, pairThreads);
 	cout << "reading config.txt" << endl;
+	if (packSequence > 0)//1 : raw images, N : PNG level N - 1
+		return SequencePack::pack(DataSetFolderName, calibFileName, DataSetFolderName + ".kpack",
+			formatImage, packSequence - 1) ? 0 : 1;
 
 
-	KITTI_Data_Reader reader(DataSetFolderName, formatImage);
-	cout << "Image number in this dir : " << reader.getMaxIndex() << endl;
+	FrameSource *source = openFrameSource(inputType, DataSetFolderName, formatImage, rawParam);
+	cout << "Image number in this dir : " << source->getFramesNum() << endl;
 
-	RectifyStereo rectifyStereo(calibFileName, rectified);
+	//a pack carries its own calibration
+	Calib_Data_Type packCalib;
+	RectifyStereo rectifyStereo = source->readCalib(packCalib) ? RectifyStereo(packCalib, rectified) :
+		RectifyStereo(calibFileName, rectified);
 	if (!rectified && !rectifyStereo.isLoadCameraParam)
 	{
 		cout << "Camera Param is not loaded! Promgram exits..." << endl;
@@ -74,6 +183,12 @@ int main2(){
 	}
 
 	Calib_Data_Type calibData = rectifyStereo.calibData;
+	LidarGroundEstimator lidarGroundEstimator;
+	if (lidarGround > 0 && !initLidarGround(calibFileName, calibData, lidarGroundEstimator))
+	{
+		cout << "calib_velo_to_cam.txt is not found, no ground plane from the velodyne." << endl;
+		lidarGround = 0;
+	}
 
 	CC::CC_SimpleIPM ipm;
 	ipm.createModel(calibData.P_rect_00[0], calibData.P_rect_00[5], calibData.P_rect_00[2], calibData.P_rect_00[6],
@@ -84,20 +199,72 @@ int main2(){
 		enumSetting = Elas::MIDDLEBURY;
 
 	Elas::parameters param(enumSetting);
+	if (elasSetting == 2 || elasSetting == 4) // half resolution disparity map, about 4x faster
+		param.subsampling = 1;
+	if (elasSetting == 3 || elasSetting == 4) // support points triangulated on their lattice instead of delaunay
+		param.grid_triangulation = 1;
 	InterfaceProcessELAS procELAS(param);//instance for computing disparity map
 
 	Ptr<StereoSGBM> sgbm = StereoSGBM::create(0, 256, 11);//sgbm for computing dm
 	Ptr<StereoBM> bm = StereoBM::create(0, 15);//sgbm for computing dm
 
-
+	//noDisparity != 0 : full disparity every frameInterval frames, warped with visual odometry in between
+	bool predictDisparity = noDisparity != 0 && frameInterval > 1;
+	InterfaceProcessVISO procVISO(calibData);
+	DisparityPredictor::Param predParam;
+	predParam.interval = frameInterval;
+	DisparityPredictor predictor(calibData.P_rect_00[0], calibData.P_rect_00[2], calibData.P_rect_00[6],
+		procVISO.param.base, predParam);
+	//odometry of a frame runs on its own thread while the disparity and the lanes are computed
+	AsyncProcessVISO *asyncVISO = NULL;
+	if (predictDisparity || odometryPitch > 0 || roadView > 0 || roadMosaic > 0)
+		asyncVISO = new AsyncProcessVISO(&procVISO);
+	bool halfDisparity = methodeDisparity == 0 && param.subsampling;
+	if (halfDisparity)
+		predictor.setCamera(0.5 * calibData.P_rect_00[0], 0.5 * calibData.P_rect_00[2], 0.5 * calibData.P_rect_00[6],
+			procVISO.param.base);
+
+
+#ifdef DEBUG_drawImage
+	//top-down view of the road straight from the camera images, raw or rectified
+	BirdEyeMap birdEyeMap(calibData, rectified == 0);
 	Mat ipmImage;
+#endif
+	//bird's-eye view of the road along the visual odometry, on the ground of the first frame
+	InterfaceProcessIPMImage *roadViewProc = NULL;
+	RoadMosaic *roadMosaicStore = roadMosaic > 0 ? new RoadMosaic(".") : NULL;
+	if (roadView > 0 || roadMosaicStore)
+	{
+		roadViewProc = new InterfaceProcessIPMImage(calibData, h, pitch);
+		roadViewProc->setGatherMode(roadView == 2);
+		roadViewProc->setMosaic(roadMosaicStore);
+		//gps position of the vehicle drawn from the first frame of the drive, when the source has it
+		roadViewProc->setOxtsIndex(source->getOxtsIndex());
+		roadViewProc->showVehiclePosition(false, source->getOxtsIndex() != NULL);
+	}
 	int64 t0, t1;
+	//written on its own thread, the detection does not wait for the disk
+	LaneResultWriter *resultWriter = resultLog > 0 ? new LaneResultWriter("lanes.bin") : NULL;
 
-	reader.jumpToIndex(0);
-
-	Mat _ = imread(reader.curImageFileName[0]);
-	LaneDetection *lsd_ = new LaneDetection(_);
+	//the first frame is read ahead for the size of the images
+	Mat L, R;
+	bool readAhead = source->next(L, R);
+	if (!readAhead)
+	{
+		cout << "The first frame of " << DataSetFolderName << " is not read! Program exits..." << endl;
+		delete resultWriter;
+		delete roadViewProc;
+		delete roadMosaicStore;
+		delete asyncVISO;
+		delete source;
+		return 1;
+	}
+	LaneDetection *lsd_ = new LaneDetection(L);
 	lsd_->init(0, &ipm);
+	if (odometryPitch > 0)
+		lsd_->setOdometry(asyncVISO, odometryPitch);
+	lsd_->setTracking(laneTracking);
+	lsd_->setPairThreads(pairThreads);
 
 	//CC::CC_SimpleIPM ipm_r;
 	//ipm_r.createModel(calibData.P_rect_01[0], calibData.P_rect_01[5], calibData.P_rect_01[2], calibData.P_rect_01[6],
@@ -105,41 +272,124 @@ int main2(){
 	//LaneDetection *lsd_r = new LaneDetection(_);
 	//lsd_r->init(0, &ipm_r);
 
-	while (reader.generateNextDataFileName())
+	int frame_i = 0;
+	while (true)
 	{
-		if (showTimeConsuming)
-			t0 = getTickCount();
-		string left_img_file_name = reader.curImageFileName[0];
-		string right_img_file_name = reader.curImageFileName[1];
-
-		Mat L = imread(left_img_file_name, -1);
-		Mat R = imread(right_img_file_name, -1);
+		t0 = getTickCount();
+		if (!readAhead && !source->next(L, R))
+			break;
+		readAhead = false;
 
 		Mat rL, rR;//rectified images : rL, rR
+		Mat grayL, grayR;//gray images of rL, rR, converted once for all the consumers
 		if (rectified == 1)
 		{
-			L.copyTo(rL);
-			R.copyTo(rR);
+			rL = L;
+			rR = R;
+			toGray(rL, grayL);
+			toGray(rR, grayR);
 		}
 		else
-			rectifyStereo.rectifyImages(L, R, rL, rR);
+			rectifyStereo.rectifyImages(L, R, rL, rR, grayL, grayR);
+		int64 tRead = getTickCount();
 
 		if (showTimeConsuming)
 		{
 			t1 = getTickCount();
 			cout << "Reading images and rectifying images : " << (t1 - t0) / getTickFrequency() * 1000 << " ms. " << endl;
 		}
+		if (showTimeConsuming == 2 && frame_i == 0 && methodeDisparity == 0)
+			procELAS.benchmarkTriangulation(grayL, grayR);//delaunay and grid triangulation on the first pair
+		if (asyncVISO)
+			asyncVISO->push(grayL, grayR);
+		if (laneTracking > 0)
+			setEgoMotionFromOxts(*source, lsd_);
+
+		//with the ground plane of the velodyne, no disparity map : method3 instead of method4
+		bool lidarPlane = lidarGround > 0 && setGroundPlaneFromLidar(*source, lidarGroundEstimator, lsd_);
+
 		Mat disp;
-		if (methodeDisparity == 0)
-			procELAS.computeDisparity(rL, rR, disp);
-		else if (methodeDisparity == 1)
+		bool fullDisparity = !lidarPlane;
+		Mat grayPred;//gray left image at the resolution of disp
+		//the motion of a frame without disparity is not folded into the key frame : warping it later
+		//with the motion of one frame would give a wrong map
+		if (predictDisparity && lidarPlane)
+			predictor.dropKeyFrame();
+		if (predictDisparity && !lidarPlane)
+		{
+			grayPred = grayL;
+			if (halfDisparity)//same pixels as elas subsampling
+				resize(grayL, grayPred, Size(grayL.cols / 2, grayL.rows / 2), 0, 0, INTER_NEAREST);
+
+			if (!predictor.needKeyFrame())
+			{
+				Matrix44 motion;
+				if (asyncVISO->waitMotion(motion))
+					fullDisparity = !predictor.predict(motion.toMatrix(), grayPred, disp);
+				else
+				{
+					double rx, h_ipm;
+					ipm.getRxAndH(rx, h_ipm);
+					fullDisparity = !predictor.predictFlatGround(rx, h_ipm, disp);
+				}
+			}
+		}
+
+		if (fullDisparity)
 		{
-			sgbm->compute(rL, rR, disp);
-			disp.convertTo(disp, CV_8U, 1.0 / 8);
+			double dispScale = 1;
+			if (methodeDisparity == 0)
+			{
+				procELAS.computeDisparity(grayL, grayR, disp);
+				dispScale = procELAS.dispScale;
+			}
+			else if (methodeDisparity == 1)
+			{
+				sgbm->compute(rL, rR, disp);
+				disp.convertTo(disp, CV_8U, 1.0 / 8);
+				dispScale = 0.5;//sgbm gives 16 * disparity : disp is 2 * disparity
+			}
+
+			if (predictDisparity)
+				predictor.setKeyFrame(disp, dispScale, grayPred);
+		}
+
+		if (showTimeConsuming && predictDisparity)
+		{
+			cout << (fullDisparity ? "full disparity" : "predicted disparity")
+				<< ", warp residual : " << predictor.lastResidual() << endl;
 		}
 			
+		int64 tDisp = getTickCount();
+
 		//lsd_->method3(rL);
-		lsd_->method4(rL, disp);
+		vector<Pair2d> pairs, pairs_in_image;
+		vector< vector<Pair2d> > lanes = lidarPlane ? lsd_->method3(rL, 0, Mat(), grayL) :
+			lsd_->method4(rL, disp, 0, grayL);
+		if (lanes.size() == 2)
+			pairs = lanes[0], pairs_in_image = lanes[1];
+		if (resultWriter)
+			writeLaneResult(*resultWriter, frame_i, lsd_, t0, tRead, tDisp, getTickCount(), pairs, pairs_in_image);
+
+		if (roadViewProc)
+		{
+			//procVISO.pose is the pose of this frame once its odometry is done (the last one if it failed)
+			Matrix44 motion;
+			asyncVISO->waitMotion(motion);
+			Mat roadImage, roadMask;
+			Oxts_Data_Type oxts;
+			bool hasOxts = source->readOxts(oxts);
+			roadViewProc->processIPM(grayL, procVISO.pose.toMatrix(), roadImage, roadMask, hasOxts ? &oxts : NULL);
+			if (roadView > 0)
+				imshow("road view", roadImage);
+			if (roadMosaicStore)
+			{
+				Mat ringImage;
+				roadMosaicStore->getRingImage(ringImage);
+				imshow("road mosaic", ringImage);
+			}
+		}
+		frame_i++;
 
 		if (showTimeConsuming)
 		{
@@ -147,11 +397,23 @@ int main2(){
 			cout << "LaneDetection : " << (t1 - t0) / getTickFrequency() * 1000 << " ms. " << endl;
 		}
 
-		imshow("disparity map", disp);
+#ifdef DEBUG_drawImage
+		birdEyeMap.update(ipm);//only when the pitch changed
+		birdEyeMap.warp(L, ipmImage);
+		imshow("bird's-eye view", ipmImage);
+#endif
+
+		if (!disp.empty())
+			imshow("disparity map", disp);
 		//if (waitKey(10) > 0)
 			waitKey();
 	}
 	cout << "-------------------end------------------ " << endl;
+	delete resultWriter;//waits for the last frames to be written
+	delete roadViewProc;
+	delete roadMosaicStore;//writes the tiles in memory
+	delete asyncVISO;
+	delete source;
 
 	return 1;
 }
@@ -175,18 +437,35 @@ int main() {
 	int elasSetting = Elas::ROBOTICS;
 	int showTimeConsuming = 0;
 	float pitch = 0;
+	int odometryPitch = 0;
+	int laneTracking = 0;
+	int packSequence = 0;
+	int inputType = 0;
+	RawFrameSource::Param rawParam;
+	int lidarGround = 0;
+	int resultLog = 0;
+	int roadView = 0;
+	int roadMosaic = 0;
+	int pairThreads = 0;
 	string formatImage = ".png";
 
 	//read config.txt to settings:
 	parse(DataSetFolderName, calibFileName, rectified, frameInterval, h,
-		methodeDisparity, noDisparity, elasSetting, showTimeConsuming, pitch, formatImage);
+		methodeDisparity, noDisparity, elasSetting, showTimeConsuming, pitch, formatImage, odometryPitch, laneTracking,
+		packSequence, inputType, rawParam, lidarGround, resultLog, roadView, roadMosaic, pairThreads);
 	cout << "reading config.txt" << endl;
+	if (packSequence > 0)//1 : raw images, N : PNG level N - 1
+		return SequencePack::pack(DataSetFolderName, calibFileName, DataSetFolderName + ".kpack",
+			formatImage, packSequence - 1) ? 0 : 1;
 
 
-	KITTI_Data_Reader reader(DataSetFolderName, formatImage);
-	cout << "Image number in this dir : " << reader.getMaxIndex() << endl;
+	FrameSource *source = openFrameSource(inputType, DataSetFolderName, formatImage, rawParam);
+	cout << "Image number in this dir : " << source->getFramesNum() << endl;
 
-	RectifyStereo rectifyStereo(calibFileName, rectified);
+	//a pack carries its own calibration
+	Calib_Data_Type packCalib;
+	RectifyStereo rectifyStereo = source->readCalib(packCalib) ? RectifyStereo(packCalib, rectified) :
+		RectifyStereo(calibFileName, rectified);
 	if (!rectified && !rectifyStereo.isLoadCameraParam)
 	{
 		cout << "Camera Param is not loaded! Promgram exits..." << endl;
@@ -194,20 +473,54 @@ int main() {
 	}
 
 	Calib_Data_Type calibData = rectifyStereo.calibData;
+	LidarGroundEstimator lidarGroundEstimator;
+	if (lidarGround > 0 && !initLidarGround(calibFileName, calibData, lidarGroundEstimator))
+	{
+		cout << "calib_velo_to_cam.txt is not found, no ground plane from the velodyne." << endl;
+		lidarGround = 0;
+	}
 
 	CC::CC_SimpleIPM ipm;
 	ipm.createModel(calibData.P_rect_00[0], calibData.P_rect_00[5], calibData.P_rect_00[2], calibData.P_rect_00[6], 
 		pitch, h);
 
 	int frameNum = 0;
+#ifdef DEBUG_drawImage
+	//top-down view of the road straight from the camera images, raw or rectified
+	BirdEyeMap birdEyeMap(calibData, rectified == 0);
 	Mat ipmImage;
+#endif
 	int64 t0, t1;
+	//written on its own thread, the detection does not wait for the disk
+	LaneResultWriter *resultWriter = resultLog > 0 ? new LaneResultWriter("lanes.bin") : NULL;
 
-	reader.jumpToIndex(0);
+	//the right images are only used by the visual odometry, which gives the pitch of ipm
+	InterfaceProcessVISO *procVISO = NULL;
+	AsyncProcessVISO *asyncVISO = NULL;
+	if (odometryPitch > 0)
+	{
+		procVISO = new InterfaceProcessVISO(calibData);
+		asyncVISO = new AsyncProcessVISO(procVISO);
+	}
 
-	Mat _ = imread(reader.curImageFileName[0]);
-	LaneDetection *lsd_ = new LaneDetection(_);
+	//the first frame is read ahead for the size of the images
+	Mat L, R;
+	bool readAhead = source->next(L, R);
+	if (!readAhead)
+	{
+		cout << "The first frame of " << DataSetFolderName << " is not read! Program exits..." << endl;
+		delete resultWriter;
+		delete asyncVISO;
+		delete source;
+		delete procVISO;
+		return 1;
+	}
+	LaneDetection *lsd_ = new LaneDetection(L);
 	lsd_->init(0, &ipm);
+	if (odometryPitch > 0)
+		lsd_->setOdometry(asyncVISO, odometryPitch);
+	lsd_->setTracking(laneTracking);
+	lsd_->setPairThreads(pairThreads);
 	
 	//CC::CC_SimpleIPM ipm_r;
 	//ipm_r.createModel(calibData.P_rect_01[0], calibData.P_rect_01[5], calibData.P_rect_01[2], calibData.P_rect_01[6],
@@ -216,25 +529,26 @@ int main() {
 	//lsd_r->init(0, &ipm_r);
 
 	int frame_i = 0;
-	while (reader.generateNextDataFileName())
+	while (true)
 	{
+		t0 = getTickCount();
+		if (!readAhead && !source->next(L, R))
+			break;
+		readAhead = false;
 		cout << "frame----------------------" << frame_i++ << endl;
-		if (showTimeConsuming)
-			t0 = getTickCount();
-		string left_img_file_name = reader.curImageFileName[0];
-		string right_img_file_name = reader.curImageFileName[1];
-
-		Mat L = imread(left_img_file_name, -1);
-		Mat R = imread(right_img_file_name, -1);
 
 		Mat rL, rR;//rectified images : rL, rR
+		Mat grayL, grayR;//gray images of rL, rR, converted once for all the consumers
 		if (rectified == 1)
 		{
-			L.copyTo(rL);
-			R.copyTo(rR);
+			rL = L;
+			rR = R;
+			toGray(rL, grayL);
+			toGray(rR, grayR);
 		}
 		else
-			rectifyStereo.rectifyImages(L, R, rL, rR);
+			rectifyStereo.rectifyImages(L, R, rL, rR, grayL, grayR);
+		int64 tRead = getTickCount();
 
 		if (showTimeConsuming)
 		{
@@ -242,12 +556,21 @@ int main() {
 			cout << "Reading images and rectifying images : " << (t1 - t0) / getTickFrequency() * 1000 << " ms. " << endl;
 		}
 
+		if (asyncVISO)
+			asyncVISO->push(grayL, grayR);
+		if (laneTracking > 0)
+			setEgoMotionFromOxts(*source, lsd_);
+
 		//Mat maskRoad;
 		//easyInterface(rL, maskRoad);
 		//cvtColor(rL, rL, CV_BGR2GRAY);
 		//adaptiveThreshold(rL, rL, 255, ADAPTIVE_THRESH_GAUSSIAN_C, THRESH_BINARY, 5, 5);
-		lsd_->method3(rL);
+		if (lidarGround > 0)
+			setGroundPlaneFromLidar(*source, lidarGroundEstimator, lsd_);
+		vector< vector<Pair2d> > lanes = lsd_->method3(rL, 0, Mat(), grayL);
 		//lsd_r->method3(rR, 1);
+		if (resultWriter && lanes.size() == 2)
+			writeLaneResult(*resultWriter, frame_i - 1, lsd_, t0, tRead, tRead, getTickCount(), lanes[0], lanes[1]);
 
 
 
@@ -257,9 +580,19 @@ int main() {
 			cout << "LaneDetection : " << (t1 - t0) / getTickFrequency() * 1000 << " ms. " << endl;
 		}
 
+#ifdef DEBUG_drawImage
+		birdEyeMap.update(ipm);//only when the pitch changed
+		birdEyeMap.warp(L, ipmImage);
+		imshow("bird's-eye view", ipmImage);
+#endif
+
 		//imshow("maskRoad", maskRoad);
 		//if (waitKey(10) > 0)
 			waitKey();
 	}
 	cout << "-------------------end------------------ " << endl;
+	delete resultWriter;//waits for the last frames to be written
+	delete asyncVISO;
+	delete source;
+	delete procVISO;
 }
\ No newline at end of file